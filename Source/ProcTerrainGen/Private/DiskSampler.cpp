@@ -3,57 +3,117 @@
 
 #include "DiskSampler.h"
 
+namespace
+{
+	//Background grid of a single sampling run, each cell holds at most one point
+	struct FDiskSamplerGrid
+	{
+		int mRows;
+		int mColumns;
+		float mWidth;
+		float mHeight;
+		float mRadius;
+		float mCellSize;
+		TArray<int> DataGrid;
+
+		FIntPoint GetGridCellFromPosition(const FVector2D& Position) const
+		{
+			FIntPoint GridCell;
+			GridCell.X = (int) (Position.X / mCellSize);
+			GridCell.Y = (int) (Position.Y / mCellSize);
+
+			return GridCell;
+		}
+
+		bool IsPointValid(const FVector2D& Point, const TArray<FVector2D>& PointList) const
+		{
+			//Test for point validity
+			if (Point.X > mWidth || Point.X < 0 || Point.Y < 0 || Point.Y > mHeight)
+				return false;
+
+			FIntPoint GridCell = GetGridCellFromPosition(Point);
+
+			int StartX = FMath::Max(0, GridCell.X - 2);
+			int StartY = FMath::Max(0, GridCell.Y - 2);
+
+			int EndX = FMath::Min(mColumns - 1, GridCell.X + 2);
+			int EndY = FMath::Min(mRows - 1, GridCell.Y + 2);
+
+			for (int i = StartX; i <= EndX; i++)
+			{
+				for (int j = StartY; j <= EndY; j++)
+				{
+					int PointIndex = DataGrid[i + j * mColumns];
+					if (PointIndex != -1)
+					{
+						FVector2D CorrespondingPoint = PointList[PointIndex];
+						float distance = FVector2D::DistSquared(CorrespondingPoint, Point);
+
+						if (distance < (mRadius*mRadius))
+							return false;
+					}
+				}
+			}
+
+			return true;
+		}
+	};
+}
 
 void UDiskSampler::GeneratePoints(int64 seed, float width, float height, float radius, int k)
 {
-	FMath::RandInit(seed);
-	PointList.Empty();
-	ActiveList.Empty();
+	GeneratePoissonPoints(seed, width, height, radius, k, PointList);
+}
 
-	mWidth = width;
-	mHeight = height;
-	mRadius = radius;
+void UDiskSampler::GeneratePoissonPoints(int64 seed, float width, float height, float radius, int k, TArray<FVector2D>& OutPoints)
+{
+	//A local stream instead of the global FMath generator so sections can be sampled on several threads at once
+	FRandomStream Random((int32) seed);
+	OutPoints.Empty();
+	TArray<FVector2D> ActiveList;
+
+	FDiskSamplerGrid Grid;
+	Grid.mWidth = width;
+	Grid.mHeight = height;
+	Grid.mRadius = (int) radius;
 	// radius / sqrt(2)
-	mCellSize = radius / 1.41421356f;
+	Grid.mCellSize = radius / 1.41421356f;
 
-	mRows = FMath::CeilToInt(width / mCellSize);
-	mColumns = FMath::CeilToInt(height / mCellSize);
+	Grid.mRows = FMath::CeilToInt(width / Grid.mCellSize);
+	Grid.mColumns = FMath::CeilToInt(height / Grid.mCellSize);
 
-	int numCount = mRows * mColumns;
-
-	DataGrid = (int *) FMemory::Malloc(sizeof(int) * numCount);
-	for (int a = 0; a < numCount; a++)
-		DataGrid[a] = -1;
+	int numCount = Grid.mRows * Grid.mColumns;
+	Grid.DataGrid.Init(-1, numCount);
 
 	//Generate Initial Point
-	FVector2D InitialPos(FMath::FRand() * width, FMath::FRand() * height);
+	FVector2D InitialPos(Random.FRand() * width, Random.FRand() * height);
 
 	//calculate index of point in the grid
-	FIntPoint GridCell = GetGridCellFromPosition(InitialPos);
+	FIntPoint GridCell = Grid.GetGridCellFromPosition(InitialPos);
 	
-	int ListIndex = PointList.Add(InitialPos);
-	DataGrid[GridCell.X + GridCell.Y * mColumns] = ListIndex;
+	int ListIndex = OutPoints.Add(InitialPos);
+	Grid.DataGrid[GridCell.X + GridCell.Y * Grid.mColumns] = ListIndex;
 	ActiveList.Add(InitialPos);
 
 	while (!ActiveList.IsEmpty())
 	{
-		int randIndex = FMath::RandRange(0, ActiveList.Num() - 1);
+		int randIndex = Random.RandRange(0, ActiveList.Num() - 1);
 		FVector2D origin = ActiveList[randIndex];
 		bool found = false;
 		for (int i = 0; i < k; i++)
 		{
 			//Search in range r^2 to (2r)^2 to obtain a uniform distribution then sqrt result
-			float VScale = FMath::Sqrt(FMath::RandRange(FMath::Pow(mRadius, 2), FMath::Pow(2 * mRadius, 2)));
-			FVector2D NewPoint = origin + FVector2D(FMath::FRandRange(-1.0f, 1.0f), FMath::FRandRange(-1.0f, 1.0f)).GetSafeNormal() * VScale;
+			float VScale = FMath::Sqrt(Random.FRandRange(FMath::Pow(Grid.mRadius, 2), FMath::Pow(2 * Grid.mRadius, 2)));
+			FVector2D NewPoint = origin + FVector2D(Random.FRandRange(-1.0f, 1.0f), Random.FRandRange(-1.0f, 1.0f)).GetSafeNormal() * VScale;
 
-			if (IsPointValid(NewPoint))
+			if (Grid.IsPointValid(NewPoint, OutPoints))
 			{
 				found = true;
 
-				FIntPoint PointCell = GetGridCellFromPosition(NewPoint);
-				int NewPointIndex = PointList.Add(NewPoint);
+				FIntPoint PointCell = Grid.GetGridCellFromPosition(NewPoint);
+				int NewPointIndex = OutPoints.Add(NewPoint);
 				ActiveList.Add(NewPoint);
-				DataGrid[PointCell.X + PointCell.Y * mColumns] = NewPointIndex;
+				Grid.DataGrid[PointCell.X + PointCell.Y * Grid.mColumns] = NewPointIndex;
 				break;
 			}
 		}
@@ -61,49 +121,4 @@ void UDiskSampler::GeneratePoints(int64 seed, float width, float height, float r
 		if (!found)
 			ActiveList.RemoveAt(randIndex);
 	}
-
-	FMemory::Free(DataGrid);
-}
-
-FIntPoint UDiskSampler::GetGridCellFromPosition(const FVector2D& Position)
-{
-	FIntPoint GridCell;
-	GridCell.X = (int) (Position.X / mCellSize);
-	GridCell.Y = (int) (Position.Y / mCellSize);
-
-	return GridCell;
-}
-
-bool UDiskSampler::IsPointValid(const FVector2D& Point)
-{
-	//Test for point validity
-	if (Point.X > mWidth || Point.X < 0 || Point.Y < 0 || Point.Y > mHeight)
-		return false;
-
-	FIntPoint GridCell = GetGridCellFromPosition(Point);
-
-	int StartX = FMath::Max(0, GridCell.X - 2);
-	int StartY = FMath::Max(0, GridCell.Y - 2);
-
-	int EndX = FMath::Min(mColumns - 1, GridCell.X + 2);
-	int EndY = FMath::Min(mRows - 1, GridCell.Y + 2);
-
-	for (int i = StartX; i <= EndX; i++)
-	{
-		for (int j = StartY; j <= EndY; j++)
-		{
-			int PointIndex = DataGrid[i + j * mColumns];
-			if (PointIndex != -1)
-			{
-				FVector2D CorrespondingPoint = PointList[PointIndex];
-				float distance = FVector2D::DistSquared(CorrespondingPoint, Point);
-
-				if (distance < (mRadius*mRadius))
-					return false;
-			}
-		}
-	}
-
-	return true;
 }
-
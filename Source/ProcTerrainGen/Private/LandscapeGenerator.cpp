@@ -3,6 +3,16 @@
 
 #include "LandscapeGenerator.h"
 #include "LandscapeSection.h"
+#include "Curves/CurveFloat.h"
+#include "Net/UnrealNetwork.h"
+#include "RuntimeMeshComponent.h"
+#include "Providers/RuntimeMeshProviderStatic.h"
+#include "Async/Async.h"
+#include "RenderCore.h"
+#include "TerrainRTIN.h"
+#include "SimplexNoise/Public/SimplexNoiseBPLibrary.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogLandscapeGenerator, Log, All);
 
 #define LOCTEXT_NAMESPACE "Terrain"
 
@@ -15,12 +25,258 @@ FVector2D CalculateWorldCoordinatesFromTerrainCoords(const FIntPoint& TerrainCoo
 	return WorldCoords;
 }
 
-float ALandscapeGenerator::ApplyTerrainHeightMultiplier(float value)
+void ALandscapeGenerator::RefreshTerrainHeightTable()
+{
+	if (!TerrainHeight)
+	{
+		if (TerrainHeightTable.IsValid())
+		{
+			TerrainHeightTable.Reset();
+			BakedTerrainHeightCurve = nullptr;
+			UpdateQueryNoiseParameters();
+		}
+		return;
+	}
+
+	uint32 CurveHash = HashCombine(FTerrainHeightTable::CalcCurveHash(TerrainHeight->FloatCurve), GetTypeHash(TerrainHeightTableResolution));
+	CurveHash = HashCombine(CurveHash, GetTypeHash(TerrainHeightTableMaxError));
+	if (TerrainHeightTable.IsValid() && BakedTerrainHeightCurve == TerrainHeight && BakedTerrainHeightHash == CurveHash)
+		return;
+
+	TerrainHeightTable = MakeShared<FTerrainHeightTable, ESPMode::ThreadSafe>(TerrainHeight->FloatCurve, TerrainHeightTableResolution, TerrainHeightTableMaxError);
+	BakedTerrainHeightCurve = TerrainHeight;
+	BakedTerrainHeightHash = CurveHash;
+	UpdateQueryNoiseParameters();
+}
+
+void ALandscapeGenerator::RefreshNoiseGraph()
+{
+	if (NoiseGraph.Num() == 0)
+	{
+		if (CompiledNoiseGraph.IsValid())
+		{
+			CompiledNoiseGraph.Reset();
+			UpdateQueryNoiseParameters();
+		}
+		return;
+	}
+
+	uint32 GraphHash = FCompiledNoiseGraph::CalcGraphHash(NoiseGraph);
+	if (CompiledNoiseGraph.IsValid() && CompiledNoiseGraphHash == GraphHash)
+		return;
+
+	CompiledNoiseGraph = MakeShared<FCompiledNoiseGraph, ESPMode::ThreadSafe>(NoiseGraph);
+	CompiledNoiseGraphHash = GraphHash;
+	UpdateQueryNoiseParameters();
+}
+
+void ALandscapeGenerator::UpdateQueryNoiseParameters()
+{
+	if (Erosion.bEnabled)
+		ErosionCache = MakeShared<FTerrainErosionCache, ESPMode::ThreadSafe>(Erosion, LandscapeSectionSize, NoiseSeed);
+	else
+		ErosionCache.Reset();
+
+	{
+		FRWScopeLock Lock(HeightfieldLock, SLT_Write);
+		QueryNoiseParameters = GetNoiseParameters();
+	}
+
+	//The proxy was built from the old noise
+	MarkFarFieldDirty(nullptr);
+}
+
+FTerrainNoiseParameters ALandscapeGenerator::GetNoiseParameters() const
+{
+	FTerrainNoiseParameters NoiseParams;
+	NoiseParams.NoiseScale = fNoiseScale;
+	NoiseParams.HeightScale = fHeightScale;
+	NoiseParams.Lacunarity = fLacunarity;
+	NoiseParams.Persistance = fPersistance;
+	NoiseParams.Octaves = Octaves;
+	NoiseParams.HeightTable = TerrainHeightTable;
+	NoiseParams.NoiseGraph = CompiledNoiseGraph;
+	NoiseParams.Erosion = ErosionCache;
+
+	return NoiseParams;
+}
+
+FTerrainNoiseParameters ALandscapeGenerator::MakeStandaloneNoiseParameters(int Seed) const
 {
+	FTerrainNoiseParameters NoiseParams;
+	NoiseParams.NoiseScale = fNoiseScale;
+	NoiseParams.HeightScale = fHeightScale;
+	NoiseParams.Lacunarity = fLacunarity;
+	NoiseParams.Persistance = fPersistance;
+	NoiseParams.Octaves = Octaves;
 	if (TerrainHeight)
-		return TerrainHeight->GetFloatValue(value);
+		NoiseParams.HeightTable = MakeShared<FTerrainHeightTable, ESPMode::ThreadSafe>(TerrainHeight->FloatCurve, TerrainHeightTableResolution, TerrainHeightTableMaxError);
+	if (NoiseGraph.Num() > 0)
+		NoiseParams.NoiseGraph = MakeShared<FCompiledNoiseGraph, ESPMode::ThreadSafe>(NoiseGraph);
+	if (Erosion.bEnabled)
+		NoiseParams.Erosion = MakeShared<FTerrainErosionCache, ESPMode::ThreadSafe>(Erosion, LandscapeSectionSize, Seed);
+
+	return NoiseParams;
+}
+
+void ALandscapeGenerator::PublishHeightfield(const FIntVector& Node, TSharedPtr<const FTerrainHeightfield, ESPMode::ThreadSafe> Heightfield)
+{
+	FRWScopeLock Lock(HeightfieldLock, SLT_Write);
+	ResidentHeightfields.Add(Node, Heightfield);
+}
+
+void ALandscapeGenerator::RemoveHeightfield(const FIntVector& Node, const FTerrainHeightfield* Heightfield)
+{
+	FRWScopeLock Lock(HeightfieldLock, SLT_Write);
+
+	//Only remove it if it hasn't been replaced by a newer one
+	TSharedPtr<const FTerrainHeightfield, ESPMode::ThreadSafe>* Found = ResidentHeightfields.Find(Node);
+	if (Found && Found->Get() == Heightfield)
+		ResidentHeightfields.Remove(Node);
+}
+
+float ALandscapeGenerator::SampleHeightLocked(const FVector2D& Location, const FTerrainNoiseParameters& NoiseParams) const
+{
+	//Prefer the finest resident section covering the location
+	int MaxLevel = GenerationMode == ETerrainGenerationMode::Quadtree ? QuadtreeDepth : 0;
+	for (int Level = 0; Level <= MaxLevel; Level++)
+	{
+		FVector2D NodeSize = LandscapeSectionSize * (1 << Level);
+		FIntVector Node(FMath::FloorToInt(Location.X / NodeSize.X), FMath::FloorToInt(Location.Y / NodeSize.Y), Level);
+
+		const TSharedPtr<const FTerrainHeightfield, ESPMode::ThreadSafe>* Heightfield = ResidentHeightfields.Find(Node);
+		if (Heightfield)
+			return (*Heightfield)->SampleHeight(Location);
+	}
+
+	//Away from resident sections erosion tiles are rarely cached, building them here would stall the caller
+	float Height = NoiseParams.CalculateQueryHeight(Location.X, Location.Y);
+	if (Deformation.IsValid())
+		Height += Deformation->SampleDelta(Location);
+
+	return Height;
+}
+
+FVector ALandscapeGenerator::SampleNormalLocked(const FVector2D& Location, const FTerrainNoiseParameters& NoiseParams) const
+{
+	//Central differences over one full resolution vertex
+	FVector2D Delta = LandscapeSectionSize / FVector2D(LandscapeComponentSize);
+	float HeightX1 = SampleHeightLocked(Location - FVector2D(Delta.X, 0.0), NoiseParams);
+	float HeightX2 = SampleHeightLocked(Location + FVector2D(Delta.X, 0.0), NoiseParams);
+	float HeightY1 = SampleHeightLocked(Location - FVector2D(0.0, Delta.Y), NoiseParams);
+	float HeightY2 = SampleHeightLocked(Location + FVector2D(0.0, Delta.Y), NoiseParams);
+
+	FVector Normal((HeightX1 - HeightX2) / (2.0 * Delta.X), (HeightY1 - HeightY2) / (2.0 * Delta.Y), 1.0);
+	return Normal.GetSafeNormal();
+}
+
+float ALandscapeGenerator::GetHeightAt(FVector2D Location) const
+{
+	FRWScopeLock Lock(HeightfieldLock, SLT_ReadOnly);
+	return SampleHeightLocked(Location, QueryNoiseParameters);
+}
+
+FVector ALandscapeGenerator::GetNormalAt(FVector2D Location) const
+{
+	FRWScopeLock Lock(HeightfieldLock, SLT_ReadOnly);
+	return SampleNormalLocked(Location, QueryNoiseParameters);
+}
+
+void ALandscapeGenerator::GetHeightsAt(const TArray<FVector2D>& Locations, TArray<float>& OutHeights) const
+{
+	FRWScopeLock Lock(HeightfieldLock, SLT_ReadOnly);
+
+	OutHeights.SetNumUninitialized(Locations.Num());
+	for (int i = 0; i < Locations.Num(); i++)
+		OutHeights[i] = SampleHeightLocked(Locations[i], QueryNoiseParameters);
+}
+
+void ALandscapeGenerator::GetNormalsAt(const TArray<FVector2D>& Locations, TArray<FVector>& OutNormals) const
+{
+	FRWScopeLock Lock(HeightfieldLock, SLT_ReadOnly);
 
-	return value;
+	OutNormals.SetNumUninitialized(Locations.Num());
+	for (int i = 0; i < Locations.Num(); i++)
+		OutNormals[i] = SampleNormalLocked(Locations[i], QueryNoiseParameters);
+}
+
+bool ALandscapeGenerator::LineTraceTerrain(FVector Start, FVector End, FVector& OutLocation, FVector& OutNormal) const
+{
+	FRWScopeLock Lock(HeightfieldLock, SLT_ReadOnly);
+
+	//Overlapping quadtree levels only coexist briefly while nodes swap, the nearest hit of any of them is good enough
+	double ClosestT = MAX_dbl;
+	FVector Delta = End - Start;
+	for (const TPair<FIntVector, TSharedPtr<const FTerrainHeightfield, ESPMode::ThreadSafe>>& Resident : ResidentHeightfields)
+	{
+		const FTerrainHeightfield& Heightfield = *Resident.Value;
+		if (!FMath::LineBoxIntersection(Heightfield.GetBounds(), Start, End, Delta))
+			continue;
+
+		double HitT;
+		if (Heightfield.IntersectSegment(Start, End, HitT) && HitT < ClosestT)
+			ClosestT = HitT;
+	}
+
+	if (ClosestT == MAX_dbl)
+		return false;
+
+	OutLocation = Start + Delta * ClosestT;
+	OutNormal = SampleNormalLocked(FVector2D(OutLocation), QueryNoiseParameters);
+	return true;
+}
+
+void ALandscapeGenerator::DeformTerrain(FVector2D Center, float Radius, float Amount, ETerrainDeformationMode Mode)
+{
+	if (!Deformation.IsValid() || Radius <= 0.0f)
+		return;
+
+	//Flatten aims at the procedural surface the sections show, only base sections are eroded and only from tiles already cached
+	bool bErodedEverywhere = !UseQuadtree();
+	auto CalcUndeformedHeight = [this, bErodedEverywhere](const FVector2D& Location)
+	{
+		FIntVector BaseNode(FMath::FloorToInt(Location.X / LandscapeSectionSize.X), FMath::FloorToInt(Location.Y / LandscapeSectionSize.Y), 0);
+		if (bErodedEverywhere || ResidentHeightfields.Contains(BaseNode))
+			return QueryNoiseParameters.CalculateQueryHeight(Location.X, Location.Y);
+		return QueryNoiseParameters.CalculateBaseHeight(Location.X, Location.Y);
+	};
+
+	FIntRect LatticeRect(Deformation->WorldToLattice(Center - FVector2D(Radius)), Deformation->WorldToLattice(Center + FVector2D(Radius)));
+	{
+		FRWScopeLock Lock(HeightfieldLock, SLT_ReadOnly);
+		Deformation->ModifyDeltas(LatticeRect, [this, &Center, Radius, Amount, Mode, &CalcUndeformedHeight](const FIntPoint& Lattice, float Delta)
+		{
+			FVector2D Location = Deformation->LatticeToWorld(Lattice);
+			float Falloff = FMath::SmoothStep(0.0f, 1.0f, 1.0f - FVector2D::Distance(Location, Center) / Radius);
+			if (Falloff <= 0.0f)
+				return Delta;
+
+			switch (Mode)
+			{
+			case ETerrainDeformationMode::Raise:
+				return Delta + Amount * Falloff;
+			case ETerrainDeformationMode::Lower:
+				return Delta - Amount * Falloff;
+			default:
+				//Procedural height without any deltas, so the target is reached regardless of earlier edits
+				return FMath::Lerp(Delta, Amount - CalcUndeformedHeight(Location), Falloff);
+			}
+		});
+	}
+
+	FBox2D DeformedArea(Center - FVector2D(Radius), Center + FVector2D(Radius));
+	MarkFarFieldDirty(&DeformedArea);
+
+	//Sections read neighbouring lattice points for their edge normals, so touch the ones just outside as well
+	for (ALandscapeSection* SectionObject : SectionObjects)
+	{
+		if (!SectionObject)
+			continue;
+
+		FIntRect SectionRect = SectionObject->CalcSectionLatticeRect(1 << (SectionObject->mNodeLevel + SectionObject->MeshDataLOD));
+		if (SectionRect.Min.X <= LatticeRect.Max.X && SectionRect.Max.X >= LatticeRect.Min.X && SectionRect.Min.Y <= LatticeRect.Max.Y && SectionRect.Max.Y >= LatticeRect.Min.Y)
+			SectionObject->ApplyDeformation(LatticeRect);
+	}
 }
 
 FIntPoint ALandscapeGenerator::GetCurrentGridPoint(const FVector& PlayerLocation)
@@ -31,47 +287,243 @@ FIntPoint ALandscapeGenerator::GetCurrentGridPoint(const FVector& PlayerLocation
 	return CurrentGridCoord;
 }
 
-//Returns current grid point
-FIntPoint ALandscapeGenerator::CalcVisibleGridPoints(const FVector& PlayerLocation)
+TArray<FTerrainStreamingSource> ALandscapeGenerator::GatherStreamingSources()
+{
+	TArray<FTerrainStreamingSource> Sources;
+
+	//Headless servers only need collision right around the players
+	int PlayerRadius = IsCollisionOnly() ? CollisionOnlyRadius : GenerationLevel;
+
+	//Every player pawn streams terrain, on a dedicated server these are all connected players
+	for (FConstPlayerControllerIterator Iterator = GetWorld()->GetPlayerControllerIterator(); Iterator; ++Iterator)
+	{
+		APlayerController* PlayerController = Iterator->Get();
+		APawn* CurrentPawn = PlayerController ? PlayerController->GetPawn() : nullptr;
+		if (CurrentPawn)
+			AddStreamingSource(Sources, CurrentPawn->GetActorLocation(), CurrentPawn->GetVelocity(), PlayerRadius);
+	}
+
+	StreamingAnchors.RemoveAll([](const FTerrainStreamingAnchor& Anchor) { return !Anchor.Actor.IsValid(); });
+	for (const FTerrainStreamingAnchor& Anchor : StreamingAnchors)
+		AddStreamingSource(Sources, Anchor.Actor->GetActorLocation(), Anchor.Actor->GetVelocity(), Anchor.Radius);
+
+	//Keep generating around the origin until someone is there to stream
+	if (Sources.Num() == 0)
+		AddStreamingSource(Sources, FVector(0, 0, 0), FVector::ZeroVector, PlayerRadius);
+
+	return Sources;
+}
+
+void ALandscapeGenerator::AddStreamingSource(TArray<FTerrainStreamingSource>& Sources, const FVector& Location, const FVector& Velocity, int Radius)
+{
+	FTerrainStreamingSource Source;
+	Source.Location = Location;
+	Source.Radius = Radius;
+	Source.Velocity = Velocity;
+	Source.PrefetchLocation = Location;
+
+	//Only horizontal movement changes which sections are needed
+	if (PrefetchHorizon > 0.0f)
+	{
+		FVector2D Lead = FVector2D(Velocity) * PrefetchHorizon;
+		float MaxLead = PrefetchMaxSections * FMath::Max(LandscapeSectionSize.X, LandscapeSectionSize.Y);
+		Lead = Lead.GetClampedToMaxSize(MaxLead);
+		Source.PrefetchLocation += FVector(Lead.X, Lead.Y, 0.0f);
+	}
+
+	Sources.Add(Source);
+}
+
+float ALandscapeGenerator::CalcDistanceToSourcePath(const FBox2D& Bounds, const FTerrainStreamingSource& Source)
+{
+	//Sampled along the path, steps of half the box size can't skip past it
+	FVector2D Start(Source.Location);
+	FVector2D End(Source.PrefetchLocation);
+	float StepSize = FMath::Max(1.0f, float(Bounds.GetSize().GetMin()) * 0.5f);
+	int Steps = FMath::Min(64, FMath::CeilToInt(float(FVector2D::Distance(Start, End)) / StepSize));
+
+	float Distance = TNumericLimits<float>::Max();
+	for (int i = 0; i <= Steps; i++)
+	{
+		FVector2D Point = Steps > 0 ? FMath::Lerp(Start, End, float(i) / Steps) : Start;
+		Distance = FMath::Min(Distance, FMath::Sqrt(float(Bounds.ComputeSquaredDistanceToPoint(Point))));
+	}
+
+	return Distance;
+}
+
+void ALandscapeGenerator::RegisterStreamingAnchor(AActor* Anchor, int Radius)
+{
+	if (!Anchor)
+		return;
+
+	for (FTerrainStreamingAnchor& Existing : StreamingAnchors)
+	{
+		if (Existing.Actor == Anchor)
+		{
+			Existing.Radius = Radius;
+			return;
+		}
+	}
+
+	StreamingAnchors.Add({ Anchor, Radius });
+}
+
+void ALandscapeGenerator::UnregisterStreamingAnchor(AActor* Anchor)
+{
+	StreamingAnchors.RemoveAll([Anchor](const FTerrainStreamingAnchor& Existing) { return Existing.Actor == Anchor; });
+}
+
+float ALandscapeGenerator::CalcDistanceToStreamingSources(const FVector2D& Location, const TArray<FTerrainStreamingSource>& Sources)
+{
+	float Distance = TNumericLimits<float>::Max();
+	for (const FTerrainStreamingSource& Source : Sources)
+		Distance = FMath::Min(Distance, float(FVector2D::Distance(Location, FVector2D(Source.Location))));
+
+	return Distance;
+}
+
+void ALandscapeGenerator::CalcVisibleGridPoints(const TArray<FTerrainStreamingSource>& Sources)
 {
-	FIntPoint CurrentGridCoord = GetCurrentGridPoint(PlayerLocation);
 	VisibleGridCoords.Empty();
+	VisibleCoordInfo.Empty();
 
-	for (int i = -GenerationLevel; i <= GenerationLevel; i++)
+	//Merge the visible sets, a coord takes the finest LOD any source needs
+	for (const FTerrainStreamingSource& Source : Sources)
 	{
-		for (int j = -GenerationLevel; j <= GenerationLevel; j++)
+		FIntPoint CurrentGridCoord = GetCurrentGridPoint(Source.Location);
+
+		//The window is swept along the source's prefetch path, in sections
+		FVector2D Lead = FVector2D(Source.PrefetchLocation - Source.Location) / LandscapeSectionSize;
+		float LeadLength = Lead.Size();
+		FVector2D Heading = LeadLength > KINDA_SMALL_NUMBER ? Lead / LeadLength : FVector2D::ZeroVector;
+		int Extent = Source.Radius + FMath::CeilToInt(LeadLength);
+
+		//Behind a moving source the window is trimmed by half of what it gained ahead, keeping the source's own neighbours
+		float BehindLimit = FMath::Max(1.0f, Source.Radius - LeadLength * 0.5f);
+
+		for (int i = -Extent; i <= Extent; i++)
 		{
-			FIntPoint CurrentCoord = FIntPoint(i, j);
-			VisibleGridCoords.Add(CurrentGridCoord + CurrentCoord);
+			for (int j = -Extent; j <= Extent; j++)
+			{
+				FVector2D Offset(i, j);
+				float Along = FVector2D::DotProduct(Offset, Heading);
+				FVector2D FromPath = Offset - Heading * FMath::Clamp(Along, 0.0f, LeadLength);
+				if (FromPath.GetAbsMax() > Source.Radius || -Along > BehindLimit)
+					continue;
+
+				//Sections ahead take the LOD they will need when the source passes them
+				FIntPoint Coord = CurrentGridCoord + FIntPoint(i, j);
+				float Distance = FromPath.Size();
+				int LODLevel = CalcLODLevelFromTerrainCoordDistance(Distance);
+
+				FVisibleCoordInfo* Info = VisibleCoordInfo.Find(Coord);
+				if (!Info)
+				{
+					VisibleCoordInfo.Add(Coord, { LODLevel, 1, Distance });
+					VisibleGridCoords.Add(Coord);
+				}
+				else
+				{
+					Info->LODLevel = FMath::Min(Info->LODLevel, LODLevel);
+					Info->SourceCount++;
+					Info->Distance = FMath::Min(Info->Distance, Distance);
+				}
+			}
 		}
 	}
 
-	return CurrentGridCoord;
+	//Coords beyond the ring are drawn by the far field proxy and get no section of their own
+	FarFieldCoords.Reset();
+	if (IsFarFieldActive())
+	{
+		for (const TPair<FIntPoint, FVisibleCoordInfo>& Pair : VisibleCoordInfo)
+		{
+			if (Pair.Value.Distance > FarFieldRing)
+				FarFieldCoords.Add(Pair.Key);
+		}
+
+		for (const FIntPoint& Coord : FarFieldCoords)
+			VisibleCoordInfo.Remove(Coord);
+		VisibleGridCoords.RemoveAll([this](const FIntPoint& Coord) { return FarFieldCoords.Contains(Coord); });
+	}
+
+	UpdateLODRingsFromBudget();
+
+	//Build every source's cell and its neighbours before anything further away
+	VisibleGridCoords.StableSort([this](const FIntPoint& A, const FIntPoint& B)
+	{
+		return VisibleCoordInfo[A].Distance < VisibleCoordInfo[B].Distance;
+	});
+}
+
+bool ALandscapeGenerator::IsCollisionOnly() const
+{
+	return bCollisionOnly || (bCollisionOnlyOnDedicatedServer && IsRunningDedicatedServer());
+}
+
+bool ALandscapeGenerator::UseQuadtree() const
+{
+	//Collision only servers always stream the base grid around the players
+	return GenerationMode == ETerrainGenerationMode::Quadtree && !IsCollisionOnly();
+}
+
+ALandscapeSection* ALandscapeGenerator::SpawnGridSection(const FIntPoint& Coord, int LODLevel, int InitialLOD)
+{
+	//Collision only sections are generated straight at the collision resolution
+	if (IsCollisionOnly())
+	{
+		LODLevel = 0;
+		InitialLOD = 1;
+	}
+
+	FActorSpawnParameters Params;
+	Params.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	ALandscapeSection* NewSection = GetWorld()->SpawnActor<ALandscapeSection>(ALandscapeSection::StaticClass(), FVector(0, 0, 0), FRotator::ZeroRotator, Params);
+
+	SectionObjects.Add(NewSection);
+	SectionLookup.Add(FIntVector(Coord.X, Coord.Y, 0), NewSection);
+	NewSection->InitialiseSection(this, Coord, NoiseSeed, LandscapeSectionSize, LandscapeComponentSize, GetNoiseParameters(), InitialLOD, 0);
+	NewSection->TargetLOD = LODLevel;
+
+	return NewSection;
+}
+
+void ALandscapeGenerator::RemoveSectionObject(ALandscapeSection* SectionObject)
+{
+	FIntVector Node(SectionObject->mTerrainCoords.X, SectionObject->mTerrainCoords.Y, SectionObject->mNodeLevel);
+	SectionLookup.Remove(Node);
+	LocalChecksums.Remove(Node);
+	CancelUploads(SectionObject);
+	SectionObject->RemoveSection();
+
+	SectionObjects.RemoveSingleSwap(SectionObject);
+	SectionObject->Destroy();
 }
 
 void ALandscapeGenerator::GenerateNewTerrainGrid()
 {
-	//Only one terrain can be generated and removed at the same time
+	//Up to SectionsPerPass terrains are generated per pass, each replacing one removed section
 	bool Generated = false;
+	int Spawned = 0;
+	int SectionsPerPass = FMath::Max(1, ThrottleStats.SectionsPerPass);
+	bGenerationBacklog = false;
 
-	FVector PlayerLocation;
-	APawn* CurrentPawn = GetWorld()->GetFirstPlayerController()->GetPawn();
-	if (!CurrentPawn)
-		PlayerLocation = FVector(0, 0, 0);
-	else
-		PlayerLocation = CurrentPawn->GetActorLocation();
-
-	FIntPoint CurrentGridCoord = CalcVisibleGridPoints(PlayerLocation);
+	CalcVisibleGridPoints(GatherStreamingSources());
+	UpdateFarField();
 
-	//Find removable section
-	ALandscapeSection* SectionsToRemove = nullptr;
+	//Find removable sections, a section stays alive as long as any source still references it
+	TArray<ALandscapeSection*> SectionsToRemove;
+	double Now = FPlatformTime::Seconds();
 	for (ALandscapeSection* SectionObject : SectionObjects)
 	{
-		if (!IsTerrainCoordVisible(SectionObject->mTerrainCoords))
-		{
-			SectionsToRemove = SectionObject;
-			break;
-		}
+		FVisibleCoordInfo* Info = VisibleCoordInfo.Find(SectionObject->mTerrainCoords);
+		SectionObject->SourceRefCount = Info ? Info->SourceCount : 0;
+		if (Info)
+			SectionObject->TouchDisplayedData(Now);
+		//Released once the last source referencing it moves away. Sections with a running job are left until it finishes rather than blocking on it
+		if (SectionObject->SourceRefCount == 0 && !SectionObject->bOperationRunning)
+			SectionsToRemove.Add(SectionObject);
 	}
 
 	//For each coord
@@ -80,17 +532,20 @@ void ALandscapeGenerator::GenerateNewTerrainGrid()
 		ALandscapeSection* Section = DoesTerrainCoordExist(Coord);
 		if (!Section)
 		{
+			//The rest waits for the next pass, the throttling raises SectionsPerPass while it has headroom
+			if (Spawned >= SectionsPerPass)
+			{
+				bGenerationBacklog = true;
+				break;
+			}
+
 			//Find Free section
-			if (SectionsToRemove)
+			if (SectionsToRemove.Num() > 0)
 			{
 				//Remove designated section
 				//FString debugtxt = FText::Format(LOCTEXT("Rem", "Removing terrain coord ({0},{1})"), SectionsToRemove->mTerrainCoords.X, SectionsToRemove->mTerrainCoords.Y).ToString();
 				//GEngine->AddOnScreenDebugMessage(-1, 5.0f, FColor::Green, debugtxt);
-				SectionsToRemove->RemoveSection();
-
-				SectionObjects.RemoveSingleSwap(SectionsToRemove);
-				SectionsToRemove->Destroy();
-				SectionsToRemove = nullptr;
+				RemoveSectionObject(SectionsToRemove.Pop());
 			}
 			
 			mGenerating = true;
@@ -99,25 +554,27 @@ void ALandscapeGenerator::GenerateNewTerrainGrid()
 			//GEngine->AddOnScreenDebugMessage(-1, 5.0f, FColor::Green, debugtxt);
 
 			//Calc LOD Level;
-			int LODLevel = CalcLODLevelFromTerrainCoordDistance((Coord - CurrentGridCoord).Size());
+			int LODLevel = VisibleCoordInfo[Coord].LODLevel;
+
+			int InitialLOD = 0;
+			if (bProgressiveStreaming)
+				InitialLOD = MaxLODLevel;
+			else if (bGenerateAtRingLOD)
+				InitialLOD = LODLevel;
 
 			//Spawn Actor
-			FVector Pos = FVector(CalculateWorldCoordinatesFromTerrainCoords(Coord, LandscapeSectionSize), 0.0);
-			FActorSpawnParameters Params;
-			Params.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
-			ALandscapeSection* NewSection = GetWorld()->SpawnActor<ALandscapeSection>(ALandscapeSection::StaticClass(), FVector(0,0,0), FRotator::ZeroRotator, Params);
-			
-			SectionObjects.Add(NewSection);
-			NewSection->InitialiseSection(this, Coord, NoiseSeed, LandscapeSectionSize, LandscapeComponentSize, fNoiseScale, fHeightScale, fLacunarity, fPersistance, Octaves);
+			ALandscapeSection* NewSection = SpawnGridSection(Coord, LODLevel, InitialLOD);
+			NewSection->SourceRefCount = VisibleCoordInfo[Coord].SourceCount;
 			NewSection->UpdateTerrainSection(0);
 
 			Generated = true;
-			break;
+			Spawned++;
 		}
 		else
 		{
 			//Calc LOD Level;
-			int LODLevel = CalcLODLevelFromTerrainCoordDistance((Coord - CurrentGridCoord).Size());
+			int LODLevel = VisibleCoordInfo[Coord].LODLevel;
+			Section->TargetLOD = LODLevel;
 			
 			//Only update if LOD has changed
 			if (Section->LODLevel != LODLevel)
@@ -135,95 +592,1063 @@ void ALandscapeGenerator::GenerateNewTerrainGrid()
 	}
 }
 
-ALandscapeSection* ALandscapeGenerator::DoesTerrainCoordExist(const FIntPoint& TerrainCoord)
+FBox2D ALandscapeGenerator::CalcQuadtreeNodeBounds(const FIntVector& Node)
 {
-	for (ALandscapeSection* SectionObject : SectionObjects)
-		if (SectionObject->mTerrainCoords == TerrainCoord)
-			return SectionObject;
+	FVector2D NodeSize = LandscapeSectionSize * (1 << Node.Z);
+	FVector2D Min = CalculateWorldCoordinatesFromTerrainCoords(FIntPoint(Node.X, Node.Y), NodeSize);
+	return FBox2D(Min, Min + NodeSize);
+}
+
+void ALandscapeGenerator::CollectQuadtreeLeaves(const FIntVector& Node, const TArray<FTerrainStreamingSource>& Sources, TArray<FIntVector>& OutLeaves)
+{
+	FBox2D Bounds = CalcQuadtreeNodeBounds(Node);
+	float Distance = TNumericLimits<float>::Max();
+	for (const FTerrainStreamingSource& Source : Sources)
+		Distance = FMath::Min(Distance, CalcDistanceToSourcePath(Bounds, Source));
+	float SplitDistance = Bounds.GetSize().X * QuadtreeSplitDistance;
+
+	if (Node.Z > 0 && Distance < SplitDistance)
+	{
+		for (int j = 0; j < 2; j++)
+			for (int i = 0; i < 2; i++)
+				CollectQuadtreeLeaves(FIntVector(Node.X * 2 + i, Node.Y * 2 + j, Node.Z - 1), Sources, OutLeaves);
+	}
+	else
+		OutLeaves.Add(Node);
+}
 
-	return nullptr;
+ALandscapeSection* ALandscapeGenerator::DoesQuadtreeNodeExist(const FIntVector& Node)
+{
+	ALandscapeSection** Section = SectionLookup.Find(Node);
+	return Section ? *Section : nullptr;
 }
 
-bool ALandscapeGenerator::IsTerrainCoordVisible(const FIntPoint& Coord)
+//A stale node can only be removed once every visible leaf overlapping it is displayed, otherwise holes appear
+bool ALandscapeGenerator::IsQuadtreeNodeCovered(const FIntVector& Node)
 {
-	bool found = false;
-	for (auto VisibleCoord : VisibleGridCoords)
+	FBox2D Bounds = CalcQuadtreeNodeBounds(Node);
+	for (const FIntVector& Leaf : VisibleQuadtreeNodes)
 	{
-		if (VisibleCoord == Coord)
-		{
-			found = true;
-			break;
-		}	
+		FBox2D LeafBounds = CalcQuadtreeNodeBounds(Leaf);
+		bool bOverlaps = LeafBounds.Min.X < Bounds.Max.X && LeafBounds.Max.X > Bounds.Min.X && LeafBounds.Min.Y < Bounds.Max.Y && LeafBounds.Max.Y > Bounds.Min.Y;
+		if (!bOverlaps)
+			continue;
+
+		ALandscapeSection* LeafSection = DoesQuadtreeNodeExist(Leaf);
+		if (!LeafSection || LeafSection->LODLevel != 0)
+			return false;
 	}
 
-	return found;
+	return true;
 }
 
-bool ALandscapeGenerator::IsCloseForCollision(const FIntPoint& Coords, const FVector& PlayerLocation)
+ALandscapeSection* ALandscapeGenerator::SpawnQuadtreeNode(const FIntVector& Node)
 {
-	FVector2D WorldCenterCoord = CalculateWorldCoordinatesFromTerrainCoords(Coords, LandscapeSectionSize) + (LandscapeSectionSize / 2.0f);
-	float dist = FVector2D::Distance(WorldCenterCoord, FVector2D(PlayerLocation));
-	float MaxDist = LandscapeSectionSize.Length() / 1.95f;
+	//Every node has the same vertex count, only its area changes with the level
+	FVector2D NodeSize = LandscapeSectionSize * (1 << Node.Z);
+	FActorSpawnParameters Params;
+	Params.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+	ALandscapeSection* NewSection = GetWorld()->SpawnActor<ALandscapeSection>(ALandscapeSection::StaticClass(), FVector(0, 0, 0), FRotator::ZeroRotator, Params);
 
-	return dist < MaxDist;
+	SectionObjects.Add(NewSection);
+	SectionLookup.Add(Node, NewSection);
+	NewSection->InitialiseSection(this, FIntPoint(Node.X, Node.Y), NoiseSeed, NodeSize, LandscapeComponentSize, GetNoiseParameters(), bProgressiveStreaming ? MaxLODLevel : 0, Node.Z);
+	NewSection->TargetLOD = 0;
+
+	return NewSection;
 }
 
-inline int ALandscapeGenerator::CalcLODLevelFromTerrainCoordDistance(float Distance)
+void ALandscapeGenerator::CalcVisibleQuadtreeNodes(const TArray<FTerrainStreamingSource>& Sources)
 {
-	return FMath::Floor(Distance / 1.5f);
+	//Collect leaves from the root nodes surrounding every source, shared roots are only visited once
+	FVector2D RootSize = LandscapeSectionSize * (1 << QuadtreeDepth);
+	TArray<FIntPoint> RootCoords;
+	for (const FTerrainStreamingSource& Source : Sources)
+	{
+		for (const FVector& Location : { Source.Location, Source.PrefetchLocation })
+		{
+			FIntPoint RootCoord(FMath::FloorToInt(Location.X / RootSize.X), FMath::FloorToInt(Location.Y / RootSize.Y));
+			for (int i = -QuadtreeRootExtent; i <= QuadtreeRootExtent; i++)
+				for (int j = -QuadtreeRootExtent; j <= QuadtreeRootExtent; j++)
+					RootCoords.AddUnique(RootCoord + FIntPoint(i, j));
+		}
+	}
+
+	VisibleQuadtreeNodes.Empty();
+	for (const FIntPoint& RootCoord : RootCoords)
+		CollectQuadtreeLeaves(FIntVector(RootCoord.X, RootCoord.Y, QuadtreeDepth), Sources, VisibleQuadtreeNodes);
+
+	//Closest and smallest nodes first
+	VisibleQuadtreeNodes.Sort([this, &Sources](const FIntVector& A, const FIntVector& B)
+	{
+		return CalcDistanceToStreamingSources(CalcQuadtreeNodeBounds(A).GetCenter(), Sources) < CalcDistanceToStreamingSources(CalcQuadtreeNodeBounds(B).GetCenter(), Sources);
+	});
 }
 
-// Sets default values
-ALandscapeGenerator::ALandscapeGenerator()
+void ALandscapeGenerator::GenerateNewQuadtreeNodes()
 {
- 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
-	NoiseSeed = FDateTime::Now().ToUnixTimestamp();
+	//Up to SectionsPerPass nodes can be generated and removed at the same time
+	bool Generated = false;
+	int Spawned = 0;
+	int SectionsPerPass = FMath::Max(1, ThrottleStats.SectionsPerPass);
+	bGenerationBacklog = false;
 
-	PrimaryActorTick.bCanEverTick = true;
-	//bAllowTickBeforeBeginPlay = false;
-	//PrimaryActorTick.TickInterval = 0.5f;
-	SetActorTickInterval( 0.5f);
+	CalcVisibleQuadtreeNodes(GatherStreamingSources());
 
-	GenerationLevel = 1;
-	
-	LandscapeSectionSize = FVector2D(45000.0, 45000.0);
-	LandscapeUVScale = FVector2D(5, 5);
-	LandscapeComponentSize = FIntPoint(100, 100);
-	MaxSectionCount = 9;
+	//Remove stale nodes once they are fully covered by displayed leaves
+	TArray<ALandscapeSection*> NodesToRemove;
+	double Now = FPlatformTime::Seconds();
+	for (ALandscapeSection* SectionObject : SectionObjects)
+	{
+		FIntVector Node(SectionObject->mTerrainCoords.X, SectionObject->mTerrainCoords.Y, SectionObject->mNodeLevel);
+		if (VisibleQuadtreeNodes.Contains(Node))
+			SectionObject->TouchDisplayedData(Now);
+		else if (NodesToRemove.Num() < SectionsPerPass && !SectionObject->bOperationRunning && IsQuadtreeNodeCovered(Node))
+			NodesToRemove.Add(SectionObject);
+	}
 
-	fNoiseScale = 0.1f;
-	fHeightScale = 1.0f;
+	for (ALandscapeSection* NodeToRemove : NodesToRemove)
+		RemoveSectionObject(NodeToRemove);
 
-	fLacunarity = 2.3f;
-	fPersistance = 0.6f;
-	Octaves = 4;
+	for (const FIntVector& Node : VisibleQuadtreeNodes)
+	{
+		ALandscapeSection* Section = DoesQuadtreeNodeExist(Node);
+		if (!Section)
+		{
+			if (Spawned >= SectionsPerPass)
+			{
+				bGenerationBacklog = true;
+				break;
+			}
 
-	AddFoliage = true;
-	AddCollision = true;
+			mGenerating = true;
+			SpawnQuadtreeNode(Node);
 
-	const ConstructorHelpers::FObjectFinder<UStaticMesh> MeshObj(TEXT("StaticMesh'/Game/Meshes/Sphere.Sphere'"));
-	if(MeshObj.Succeeded())
-		TreeMesh = MeshObj.Object;
+			Generated = true;
+			Spawned++;
+		}
+		else if (Section->LODLevel != 0)
+			Section->UpdateTerrainSection(0);
+	}
 
-	mGenerating = false;
-	bCanGenerate = false;
+	if (!Generated)
+	{
+		if (mGenerating)
+		{
+			mGenerating = false;
+			OnGenerated.Broadcast();
+		}
+	}
 }
 
-UMaterialInterface* ALandscapeGenerator::GetMaterial()
+bool ALandscapeGenerator::IsFarFieldActive() const
 {
-	return LandscapeMat;
+	return bFarFieldProxy && FarFieldProvider && !UseQuadtree() && !IsCollisionOnly();
 }
 
-
-void ALandscapeGenerator::StartGeneration()
+void ALandscapeGenerator::MarkFarFieldDirty(const FBox2D* Area)
 {
-	bCanGenerate = true;
-}
+	FVector2D ChunkSize = LandscapeSectionSize * FarFieldChunkSections;
+	for (TPair<FIntPoint, FTerrainFarFieldChunk>& Pair : FarFieldChunks)
+	{
+		FTerrainFarFieldChunk& Chunk = Pair.Value;
+		if (Chunk.Cells.Num() == 0)
+			continue;
+
+		FVector2D ChunkMin = FVector2D(Pair.Key) * ChunkSize;
+		if (Area && !Area->Intersect(FBox2D(ChunkMin, ChunkMin + ChunkSize)))
+			continue;
+
+		Chunk.Revision++;
+		Chunk.CellsHash = HashCombine(FTerrainFarFieldBuilder::CalcCellsHash(Chunk.Cells), GetTypeHash(Chunk.Revision));
+	}
+}
+
+void ALandscapeGenerator::UpdateFarField()
+{
+	if (!IsFarFieldActive())
+	{
+		if (FarFieldChunks.Num() > 0)
+			ClearFarField();
+		return;
+	}
+
+	//Coords whose section hasn't been removed yet keep drawing it, the proxy fills in afterwards so nothing draws twice
+	TSet<FIntPoint> ProxyCoords;
+	for (const FIntPoint& Coord : FarFieldCoords)
+	{
+		if (!DoesTerrainCoordExist(Coord))
+			ProxyCoords.Add(Coord);
+	}
+
+	//Coords coming back inside the ring stay proxied until their section has displayed, otherwise they leave a hole
+	for (const TPair<FIntPoint, FTerrainFarFieldChunk>& Pair : FarFieldChunks)
+	{
+		for (const FTerrainFarFieldCell& Cell : Pair.Value.Cells)
+		{
+			if (!VisibleCoordInfo.Contains(Cell.Coord))
+				continue;
+
+			ALandscapeSection* Section = DoesTerrainCoordExist(Cell.Coord);
+			if (!Section || Section->LODLevel < 0 || Section->PendingUploads > 0)
+				ProxyCoords.Add(Cell.Coord);
+		}
+	}
+
+	TMap<FIntPoint, TArray<FTerrainFarFieldCell>> ChunkCells;
+	const FIntPoint Neighbours[4] = { FIntPoint(-1, 0), FIntPoint(1, 0), FIntPoint(0, -1), FIntPoint(0, 1) };
+	for (const FIntPoint& Coord : ProxyCoords)
+	{
+		FTerrainFarFieldCell Cell;
+		Cell.Coord = Coord;
+		Cell.ProxyNeighbours = 0;
+		for (int Side = 0; Side < 4; Side++)
+		{
+			if (ProxyCoords.Contains(Coord + Neighbours[Side]))
+				Cell.ProxyNeighbours |= 1 << Side;
+		}
+
+		FIntPoint ChunkCoord(FMath::FloorToInt(float(Coord.X) / FarFieldChunkSections), FMath::FloorToInt(float(Coord.Y) / FarFieldChunkSections));
+		ChunkCells.FindOrAdd(ChunkCoord).Add(Cell);
+	}
+
+	//Chunks left without cells are removed once any build still running for them completes
+	for (TPair<FIntPoint, FTerrainFarFieldChunk>& Pair : FarFieldChunks)
+	{
+		if (!ChunkCells.Contains(Pair.Key))
+		{
+			Pair.Value.Cells.Reset();
+			Pair.Value.CellsHash = 0;
+		}
+	}
+
+	for (TPair<FIntPoint, TArray<FTerrainFarFieldCell>>& Pair : ChunkCells)
+	{
+		Pair.Value.Sort([](const FTerrainFarFieldCell& A, const FTerrainFarFieldCell& B)
+		{
+			return A.Coord.Y != B.Coord.Y ? A.Coord.Y < B.Coord.Y : A.Coord.X < B.Coord.X;
+		});
+
+		FTerrainFarFieldChunk& Chunk = FarFieldChunks.FindOrAdd(Pair.Key);
+		Chunk.CellsHash = HashCombine(FTerrainFarFieldBuilder::CalcCellsHash(Pair.Value), GetTypeHash(Chunk.Revision));
+		Chunk.Cells = MoveTemp(Pair.Value);
+	}
+
+	//Changed chunks are built on the thread pool, the displayed mesh stays until the new one is ready
+	int RunningBuilds = 0;
+	for (const TPair<FIntPoint, FTerrainFarFieldChunk>& Pair : FarFieldChunks)
+	{
+		if (Pair.Value.bBuilding)
+			RunningBuilds++;
+	}
+
+	for (TPair<FIntPoint, FTerrainFarFieldChunk>& Pair : FarFieldChunks)
+	{
+		if (RunningBuilds >= FarFieldMaxBuilds)
+			break;
+
+		FTerrainFarFieldChunk& Chunk = Pair.Value;
+		if (Chunk.bBuilding || Chunk.Cells.Num() == 0 || Chunk.CellsHash == Chunk.BuiltHash)
+			continue;
+
+		FTerrainFarFieldBuilder Builder;
+		Builder.NoiseParams = GetNoiseParameters();
+		Builder.Deformation = Deformation;
+		Builder.SectionSize = LandscapeSectionSize;
+		Builder.Resolution = FarFieldResolution;
+		Builder.SkirtDepth = FarFieldSkirtDepth;
+		Builder.Cells = Chunk.Cells;
+
+		Chunk.bBuilding = true;
+		Chunk.BuildingHash = Chunk.CellsHash;
+		Chunk.PendingMesh = Async(EAsyncExecution::ThreadPool, [Builder = MoveTemp(Builder)]()
+		{
+			FTerrainFarFieldMesh Mesh;
+			Builder.Build(Mesh);
+			return Mesh;
+		});
+		RunningBuilds++;
+	}
+}
+
+void ALandscapeGenerator::ProcessFarField()
+{
+	if (!FarFieldProvider)
+		return;
+
+	bool bUploaded = false;
+	for (TMap<FIntPoint, FTerrainFarFieldChunk>::TIterator It = FarFieldChunks.CreateIterator(); It; ++It)
+	{
+		FTerrainFarFieldChunk& Chunk = It.Value();
+		if (Chunk.bBuilding)
+		{
+			//Chunks are much larger than section uploads, display at most one per frame
+			if (bUploaded || !Chunk.PendingMesh.IsReady())
+				continue;
+
+			Chunk.bBuilding = false;
+			Chunk.BuiltHash = Chunk.BuildingHash;
+			if (Chunk.Cells.Num() > 0)
+			{
+				const FTerrainFarFieldMesh& Mesh = Chunk.PendingMesh.Get();
+				if (Chunk.MeshSection == INDEX_NONE)
+					Chunk.MeshSection = FreeFarFieldSections.Num() > 0 ? FreeFarFieldSections.Pop() : NextFarFieldSection++;
+
+				FarFieldProvider->CreateSectionFromComponents(0, Chunk.MeshSection, 0, Mesh.Vertices, Mesh.Indices, Mesh.Normals, TArray<FVector2f>(), TArray<FColor>(), TArray<FRuntimeMeshTangent>(), ERuntimeMeshUpdateFrequency::Infrequent, false);
+				bUploaded = true;
+			}
+			Chunk.PendingMesh = TFuture<FTerrainFarFieldMesh>();
+		}
+
+		if (!Chunk.bBuilding && Chunk.Cells.Num() == 0)
+		{
+			if (Chunk.MeshSection != INDEX_NONE)
+			{
+				FarFieldProvider->ClearSection(0, Chunk.MeshSection);
+				FreeFarFieldSections.Add(Chunk.MeshSection);
+			}
+			It.RemoveCurrent();
+		}
+	}
+}
+
+void ALandscapeGenerator::ClearFarField()
+{
+	//Running builds finish on their own, their futures are simply dropped
+	for (const TPair<FIntPoint, FTerrainFarFieldChunk>& Pair : FarFieldChunks)
+	{
+		if (Pair.Value.MeshSection != INDEX_NONE)
+			FarFieldProvider->ClearSection(0, Pair.Value.MeshSection);
+	}
+
+	FarFieldChunks.Empty();
+	FreeFarFieldSections.Empty();
+	NextFarFieldSection = 0;
+}
+
+ALandscapeSection* ALandscapeGenerator::DoesTerrainCoordExist(const FIntPoint& TerrainCoord)
+{
+	return DoesQuadtreeNodeExist(FIntVector(TerrainCoord.X, TerrainCoord.Y, 0));
+}
+
+bool ALandscapeGenerator::IsTerrainCoordVisible(const FIntPoint& Coord)
+{
+	return VisibleCoordInfo.Contains(Coord);
+}
+
+bool ALandscapeGenerator::IsCloseForCollision(const FIntPoint& Coords, const FVector& PlayerLocation)
+{
+	FVector2D WorldCenterCoord = CalculateWorldCoordinatesFromTerrainCoords(Coords, LandscapeSectionSize) + (LandscapeSectionSize / 2.0f);
+	float dist = FVector2D::Distance(WorldCenterCoord, FVector2D(PlayerLocation));
+	float MaxDist = LandscapeSectionSize.Length() / 1.95f;
+
+	return dist < MaxDist;
+}
+
+int ALandscapeGenerator::CalcLODLevelFromTerrainCoordDistance(float Distance)
+{
+	int LOD = 0;
+	while (LOD < MaxLODLevel && LOD < LODRingDistances.Num() && Distance >= LODRingDistances[LOD])
+		LOD++;
+
+	return LOD;
+}
+
+int64 ALandscapeGenerator::CalcGridTriangleCount(float RingScale, int64& OutVertexCount)
+{
+	int64 TriangleCount = 0;
+	OutVertexCount = 0;
+
+	//Counts the merged visible set, so every source, prefetch sweeps and the far field cutoff are accounted for
+	for (const TPair<FIntPoint, FVisibleCoordInfo>& Pair : VisibleCoordInfo)
+	{
+		int LOD = FMath::Min(FMath::FloorToInt(Pair.Value.Distance / RingScale), MaxLODLevel);
+		int64 GridX = CalcLODGridSize(LandscapeComponentSize.X, LOD);
+		int64 GridY = CalcLODGridSize(LandscapeComponentSize.Y, LOD);
+
+		OutVertexCount += GridX * GridY;
+		TriangleCount += 2 * (GridX - 1) * (GridY - 1);
+	}
+
+	return TriangleCount;
+}
+
+void ALandscapeGenerator::UpdateLODRingsFromBudget()
+{
+	if ((TargetTriangleBudget <= 0 && TargetVertexBudget <= 0) || UseQuadtree())
+		return;
+
+	auto IsWithinBudget = [this](float RingScale)
+	{
+		int64 VertexCount;
+		int64 TriangleCount = CalcGridTriangleCount(RingScale, VertexCount);
+		return (TargetTriangleBudget <= 0 || TriangleCount <= TargetTriangleBudget) && (TargetVertexBudget <= 0 || VertexCount <= TargetVertexBudget);
+	};
+
+	//Wider rings mean more detail, find the widest ring spacing that still fits the budget
+	float Low = 0.01f;
+	float High = 1.0f;
+	for (const TPair<FIntPoint, FVisibleCoordInfo>& Pair : VisibleCoordInfo)
+		High = FMath::Max(High, Pair.Value.Distance + 1.0f);
+	if (IsWithinBudget(High))
+		Low = High;
+	else
+	{
+		for (int Iteration = 0; Iteration < 24; Iteration++)
+		{
+			float Mid = (Low + High) * 0.5f;
+			if (IsWithinBudget(Mid))
+				Low = Mid;
+			else
+				High = Mid;
+		}
+	}
+
+	//Even the tightest rings can be over budget, warn once until the visible set fits again
+	bool bExceeded = !IsWithinBudget(Low);
+	if (bExceeded && !bLODBudgetExceeded)
+	{
+		int64 VertexCount;
+		int64 TriangleCount = CalcGridTriangleCount(Low, VertexCount);
+		UE_LOG(LogLandscapeGenerator, Warning, TEXT("LOD budget can't be met, %d visible sections need %lld triangles and %lld vertices at the tightest ring spacing"), VisibleCoordInfo.Num(), TriangleCount, VertexCount);
+	}
+	bLODBudgetExceeded = bExceeded;
+
+	LODRingDistances.SetNum(MaxLODLevel);
+	for (int i = 0; i < MaxLODLevel; i++)
+		LODRingDistances[i] = Low * (i + 1);
+
+	//Ring distances changed under the visible set, LOD is monotonic in distance so the closest source still decides
+	for (TPair<FIntPoint, FVisibleCoordInfo>& Pair : VisibleCoordInfo)
+		Pair.Value.LODLevel = CalcLODLevelFromTerrainCoordDistance(Pair.Value.Distance);
+}
+
+int ALandscapeGenerator::CalcMaxJobs() const
+{
+	return MaxConcurrentJobs > 0 ? MaxConcurrentJobs : FMath::Max(1, FPlatformMisc::NumberOfCoresIncludingHyperthreads() - 1);
+}
+
+bool ALandscapeGenerator::TryReserveJob()
+{
+	//Warm-up runs before the player can see anything, it always gets every worker
+	int MaxJobs = CalcMaxJobs();
+	if (bAdaptiveThrottling && !bWarmingUp && ThrottleStats.JobLimit > 0)
+		MaxJobs = FMath::Min(MaxJobs, ThrottleStats.JobLimit);
+
+	if (ActiveJobs.GetValue() >= MaxJobs)
+		return false;
+
+	ActiveJobs.Increment();
+	return true;
+}
+
+void ALandscapeGenerator::DispatchPendingOperations()
+{
+	TArray<ALandscapeSection*> PendingSections;
+	for (ALandscapeSection* SectionObject : SectionObjects)
+		if (SectionObject->bOperationPending && SectionObject->PendingUploads == 0)
+			PendingSections.Add(SectionObject);
+
+	if (PendingSections.Num() == 0)
+		return;
+
+	//Sections closest to any streaming source get the free worker slots first
+	TArray<FTerrainStreamingSource> Sources = GatherStreamingSources();
+	PendingSections.Sort([this, &Sources](const ALandscapeSection& A, const ALandscapeSection& B)
+	{
+		return CalcDistanceToStreamingSources(FVector2D(A.mMeshOrigin) + A.mSectionSize / 2.0f, Sources) < CalcDistanceToStreamingSources(FVector2D(B.mMeshOrigin) + B.mSectionSize / 2.0f, Sources);
+	});
+
+	for (ALandscapeSection* PendingSection : PendingSections)
+		if (!PendingSection->StartPendingOperation())
+			break;
+}
+
+void ALandscapeGenerator::EnqueueUpload(ALandscapeSection* Section, ETerrainUploadType Type, int64 Bytes, TFunction<void()> Work)
+{
+	for (FTerrainUploadRequest& Request : UploadQueue)
+	{
+		if (Request.Section.Get() == Section && Request.Type == Type)
+		{
+			Request.Bytes = Bytes;
+			Request.Work = MoveTemp(Work);
+			return;
+		}
+	}
+
+	UploadQueue.Add({ Section, Type, Bytes, MoveTemp(Work) });
+	Section->PendingUploads++;
+	UploadStats.QueuedRequests = UploadQueue.Num();
+}
+
+void ALandscapeGenerator::CancelUploads(ALandscapeSection* Section)
+{
+	UploadQueue.RemoveAll([Section](const FTerrainUploadRequest& Request) { return !Request.Section.IsValid() || Request.Section.Get() == Section; });
+	Section->PendingUploads = 0;
+	UploadStats.QueuedRequests = UploadQueue.Num();
+}
+
+void ALandscapeGenerator::UpdateThrottling(float DeltaTime)
+{
+	int MaxJobs = CalcMaxJobs();
+	if (!bAdaptiveThrottling)
+	{
+		ThrottleStats.JobLimit = MaxJobs;
+		ThrottleStats.UploadBudgetMilliseconds = UploadBudgetMilliseconds;
+		ThrottleStats.UploadBudgetBytes = UploadBudgetBytes;
+		ThrottleStats.SectionsPerPass = 1;
+		ThrottleStats.GenerationInterval = GenerationInterval;
+		return;
+	}
+
+	//Game thread time leaves out waiting on the renderer and vsync, so a capped frame rate still shows its headroom
+	float FrameMilliseconds = FPlatformTime::ToMilliseconds(GGameThreadTime);
+	if (FrameMilliseconds <= 0.0f)
+		FrameMilliseconds = DeltaTime * 1000.0f;
+
+	int MinJobs = FMath::Clamp(MinConcurrentJobs, 1, MaxJobs);
+	int JobLimit = FMath::Clamp(ThrottleStats.JobLimit, MinJobs, MaxJobs);
+	int SectionsPerPass = FMath::Clamp(ThrottleStats.SectionsPerPass, 1, FMath::Max(1, MaxSectionsPerPass));
+	float MinInterval = FMath::Min(MinGenerationInterval, GenerationInterval);
+	float Interval = FMath::Clamp(ThrottleStats.GenerationInterval, MinInterval, GenerationInterval);
+	float Utilisation = FMath::Min(1.0f, (float)ActiveJobs.GetValue() / JobLimit);
+
+	const float Smoothing = 0.1f;
+	ThrottleStats.FrameMilliseconds = ThrottleStats.FrameMilliseconds > 0.0f ? FMath::Lerp(ThrottleStats.FrameMilliseconds, FrameMilliseconds, Smoothing) : FrameMilliseconds;
+	ThrottleStats.WorkerUtilisation = FMath::Lerp(ThrottleStats.WorkerUtilisation, Utilisation, Smoothing);
+
+	ThrottleTimer += DeltaTime;
+	if (ThrottleTimer >= ThrottleInterval && !bWarmingUp)
+	{
+		ThrottleTimer = 0.0f;
+		ThrottleStats.LastDecision = ETerrainThrottleDecision::Hold;
+
+		if (ThrottleStats.FrameMilliseconds > TargetFrameMilliseconds)
+		{
+			//Back off faster than we ramp up so a hitch is answered within a couple of decisions
+			if (JobLimit > MinJobs || ThrottleUploadScale > MinUploadBudgetScale || SectionsPerPass > 1 || Interval < GenerationInterval)
+			{
+				JobLimit = FMath::Max(MinJobs, JobLimit - 1);
+				ThrottleUploadScale = FMath::Max(MinUploadBudgetScale, ThrottleUploadScale * 0.5f);
+				SectionsPerPass = FMath::Max(1, SectionsPerPass / 2);
+				Interval = FMath::Min(GenerationInterval, Interval * 2.0f);
+				ThrottleStats.LastDecision = ETerrainThrottleDecision::Decrease;
+				ThrottleStats.Decreases++;
+			}
+		}
+		else if (ThrottleStats.FrameMilliseconds < TargetFrameMilliseconds * 0.8f)
+		{
+			//Only grow what is actually the bottleneck, idle workers or an empty queue gain nothing from a higher limit
+			bool bIncreased = false;
+			if (ThrottleStats.WorkerUtilisation > 0.75f && JobLimit < MaxJobs)
+			{
+				JobLimit++;
+				bIncreased = true;
+			}
+			if (UploadStats.QueuedRequests > 0 && ThrottleUploadScale < 1.0f)
+			{
+				ThrottleUploadScale = FMath::Min(1.0f, ThrottleUploadScale + 0.25f);
+				bIncreased = true;
+			}
+			//The last pass left visible sections unspawned, spawn more of them and more often
+			if (bGenerationBacklog && (SectionsPerPass < MaxSectionsPerPass || Interval > MinInterval))
+			{
+				SectionsPerPass = FMath::Min(FMath::Max(1, MaxSectionsPerPass), SectionsPerPass + 1);
+				Interval = FMath::Max(MinInterval, Interval * 0.75f);
+				bIncreased = true;
+			}
+			if (bIncreased)
+			{
+				ThrottleStats.LastDecision = ETerrainThrottleDecision::Increase;
+				ThrottleStats.Increases++;
+			}
+		}
+	}
+
+	ThrottleStats.JobLimit = JobLimit;
+	ThrottleStats.SectionsPerPass = SectionsPerPass;
+	ThrottleStats.GenerationInterval = Interval;
+	ThrottleStats.UploadBudgetMilliseconds = UploadBudgetMilliseconds * ThrottleUploadScale;
+	ThrottleStats.UploadBudgetBytes = (int64)(UploadBudgetBytes * ThrottleUploadScale);
+}
+
+void ALandscapeGenerator::ProcessUploadQueue()
+{
+	UploadStats.LastFrameRequests = 0;
+	UploadStats.LastFrameBytes = 0;
+	UploadStats.LastFrameMilliseconds = 0.0f;
+	if (UploadQueue.Num() == 0)
+		return;
+
+	//Closest sections first, collision before the render mesh so nothing can fall through what is already visible
+	TArray<FTerrainStreamingSource> Sources = GatherStreamingSources();
+	TMap<ALandscapeSection*, float> SectionDistances;
+	for (const FTerrainUploadRequest& Request : UploadQueue)
+	{
+		ALandscapeSection* Section = Request.Section.Get();
+		if (Section && !SectionDistances.Contains(Section))
+			SectionDistances.Add(Section, CalcDistanceToStreamingSources(FVector2D(Section->mMeshOrigin) + Section->mSectionSize / 2.0f, Sources));
+	}
+
+	UploadQueue.StableSort([&SectionDistances](const FTerrainUploadRequest& A, const FTerrainUploadRequest& B)
+	{
+		float DistanceA = SectionDistances.FindRef(A.Section.Get());
+		float DistanceB = SectionDistances.FindRef(B.Section.Get());
+		if (DistanceA != DistanceB)
+			return DistanceA < DistanceB;
+		return A.Type < B.Type;
+	});
+
+	double StartTime = FPlatformTime::Seconds();
+	int Processed = 0;
+	for (; Processed < UploadQueue.Num(); Processed++)
+	{
+		FTerrainUploadRequest& Request = UploadQueue[Processed];
+
+		//Always apply at least one request so a single large upload can't stall the queue
+		float ElapsedMilliseconds = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+		bool bOverTime = ThrottleStats.UploadBudgetMilliseconds > 0.0f && ElapsedMilliseconds >= ThrottleStats.UploadBudgetMilliseconds;
+		bool bOverBytes = ThrottleStats.UploadBudgetBytes > 0 && UploadStats.LastFrameBytes + Request.Bytes > ThrottleStats.UploadBudgetBytes;
+		if (Processed > 0 && (bOverTime || bOverBytes))
+			break;
+
+		ALandscapeSection* Section = Request.Section.Get();
+		if (!Section)
+			continue;
+
+		Section->PendingUploads--;
+		UploadStats.LastFrameRequests++;
+		UploadStats.LastFrameBytes += Request.Bytes;
+
+		TFunction<void()> Work = MoveTemp(Request.Work);
+		Work();
+	}
+
+	UploadQueue.RemoveAt(0, Processed);
+
+	UploadStats.LastFrameMilliseconds = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+	UploadStats.MaxFrameMilliseconds = FMath::Max(UploadStats.MaxFrameMilliseconds, UploadStats.LastFrameMilliseconds);
+	UploadStats.TotalRequests += UploadStats.LastFrameRequests;
+	UploadStats.TotalBytes += UploadStats.LastFrameBytes;
+	UploadStats.QueuedRequests = UploadQueue.Num();
+}
+
+void ALandscapeGenerator::EnforceMemoryBudget()
+{
+	//Tiles are only kept while a resident section's tile set holds them
+	if (ErosionCache.IsValid())
+		ErosionCache->EvictUnreferencedTiles();
+
+	MemoryStats.MeshDataBytes = 0;
+	MemoryStats.LODDataBytes = 0;
+	MemoryStats.CollisionDataBytes = 0;
+	MemoryStats.FoliagePointBytes = 0;
+	MemoryStats.HeightfieldBytes = 0;
+	MemoryStats.ErosionTileBytes = ErosionCache.IsValid() ? ErosionCache->GetMemoryUsage() : 0;
+	for (ALandscapeSection* SectionObject : SectionObjects)
+	{
+		MemoryStats.MeshDataBytes += SectionObject->GetMemoryUsage(ETerrainMemoryCategory::MeshData);
+		MemoryStats.LODDataBytes += SectionObject->GetMemoryUsage(ETerrainMemoryCategory::LODData);
+		MemoryStats.CollisionDataBytes += SectionObject->GetMemoryUsage(ETerrainMemoryCategory::CollisionData);
+		MemoryStats.FoliagePointBytes += SectionObject->GetMemoryUsage(ETerrainMemoryCategory::FoliagePoints);
+		MemoryStats.HeightfieldBytes += SectionObject->GetMemoryUsage(ETerrainMemoryCategory::Heightfield);
+	}
+	MemoryStats.TotalBytes = MemoryStats.MeshDataBytes + MemoryStats.LODDataBytes + MemoryStats.CollisionDataBytes + MemoryStats.FoliagePointBytes + MemoryStats.HeightfieldBytes + MemoryStats.ErosionTileBytes;
+
+	int64 BudgetBytes = int64(TerrainMemoryBudgetMB) * 1024 * 1024;
+	if (BudgetBytes <= 0 || MemoryStats.TotalBytes <= BudgetBytes)
+		return;
+
+	TArray<FTerrainStreamingSource> Sources = GatherStreamingSources();
+	TMap<const ALandscapeSection*, float> SectionDistances;
+	for (ALandscapeSection* SectionObject : SectionObjects)
+		SectionDistances.Add(SectionObject, CalcDistanceToStreamingSources(FVector2D(SectionObject->mMeshOrigin) + SectionObject->mSectionSize / 2.0f, Sources));
+
+	//Cheapest data to regenerate goes first, full resolution copies of far sections, then cached LODs, then collision
+	static const ETerrainMemoryCategory EvictionOrder[] = { ETerrainMemoryCategory::MeshData, ETerrainMemoryCategory::LODData, ETerrainMemoryCategory::CollisionData };
+	for (ETerrainMemoryCategory Category : EvictionOrder)
+	{
+		TArray<ALandscapeSection*> Candidates;
+		for (ALandscapeSection* SectionObject : SectionObjects)
+			if (SectionObject->GetMemoryUsage(Category) > 0)
+				Candidates.Add(SectionObject);
+
+		//Visible sections are all touched with the same time on each grid pass, among those the furthest go first
+		Candidates.Sort([Category, &SectionDistances](const ALandscapeSection& A, const ALandscapeSection& B)
+		{
+			double LastUsedA = A.GetLastUsedTime(Category);
+			double LastUsedB = B.GetLastUsedTime(Category);
+			if (LastUsedA != LastUsedB)
+				return LastUsedA < LastUsedB;
+			return SectionDistances.FindRef(&A) > SectionDistances.FindRef(&B);
+		});
+
+		for (ALandscapeSection* Candidate : Candidates)
+		{
+			int64 Freed = Candidate->EvictData(Category);
+			if (Freed <= 0)
+				continue;
+
+			MemoryStats.TotalBytes -= Freed;
+			switch (Category)
+			{
+			case ETerrainMemoryCategory::MeshData:
+				MemoryStats.MeshDataBytes -= Freed;
+				MemoryStats.MeshDataEvictions++;
+				break;
+			case ETerrainMemoryCategory::LODData:
+				MemoryStats.LODDataBytes -= Freed;
+				MemoryStats.LODDataEvictions++;
+				break;
+			default:
+				MemoryStats.CollisionDataBytes -= Freed;
+				MemoryStats.CollisionDataEvictions++;
+				break;
+			}
+
+			if (MemoryStats.TotalBytes <= BudgetBytes)
+				return;
+		}
+	}
+}
+
+void ALandscapeGenerator::BeginWarmup()
+{
+	//Enqueue the whole initial visible set at once, worker slots are handed out as jobs complete
+	TArray<FTerrainStreamingSource> Sources = GatherStreamingSources();
+	WarmupTotalSections = 0;
+	WarmupCompletedSections = -1;
+
+	if (UseQuadtree())
+	{
+		CalcVisibleQuadtreeNodes(Sources);
+		for (const FIntVector& Node : VisibleQuadtreeNodes)
+		{
+			if (!DoesQuadtreeNodeExist(Node))
+				SpawnQuadtreeNode(Node);
+			WarmupTotalSections++;
+		}
+	}
+	else
+	{
+		CalcVisibleGridPoints(Sources);
+		UpdateFarField();
+		for (const FIntPoint& Coord : VisibleGridCoords)
+		{
+			if (!DoesTerrainCoordExist(Coord))
+			{
+				const FVisibleCoordInfo& Info = VisibleCoordInfo[Coord];
+				ALandscapeSection* NewSection = SpawnGridSection(Coord, Info.LODLevel, bGenerateAtRingLOD ? Info.LODLevel : 0);
+				NewSection->SourceRefCount = Info.SourceCount;
+			}
+			WarmupTotalSections++;
+		}
+	}
+
+	mGenerating = true;
+	bWarmingUp = true;
+}
+
+void ALandscapeGenerator::UpdateWarmup()
+{
+	int Completed = 0;
+	for (ALandscapeSection* SectionObject : SectionObjects)
+	{
+		if (SectionObject->TargetLOD >= 0 && SectionObject->LODLevel == SectionObject->TargetLOD && SectionObject->PendingUploads == 0)
+			Completed++;
+		else
+			SectionObject->UpdateTerrainSection(SectionObject->TargetLOD);
+	}
+
+	if (Completed != WarmupCompletedSections)
+	{
+		WarmupCompletedSections = Completed;
+		float Percent = WarmupTotalSections > 0 ? 100.0f * Completed / WarmupTotalSections : 100.0f;
+		OnWarmupProgress.Broadcast(Percent, Completed);
+	}
+
+	//Switch to normal budgeted streaming once the initial set is displayed
+	if (Completed >= WarmupTotalSections)
+	{
+		bWarmingUp = false;
+		mGenerating = false;
+		OnGenerated.Broadcast();
+	}
+}
+
+// Sets default values
+ALandscapeGenerator::ALandscapeGenerator()
+{
+ 	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
+	NoiseSeed = FDateTime::Now().ToUnixTimestamp();
+	bGenerationRequested = false;
+
+	//Only the settings replicate, every client generates the terrain itself
+	bReplicates = true;
+	bAlwaysRelevant = true;
+	MaxReplicatedChecksums = 256;
+	NextServerChecksum = 0;
+
+	//Far field chunks are built in world space, the proxy ignores wherever the generator is placed
+	FarFieldMesh = CreateDefaultSubobject<URuntimeMeshComponent>(TEXT("FarFieldMesh"));
+	RootComponent = FarFieldMesh;
+	FarFieldMesh->SetUsingAbsoluteLocation(true);
+	FarFieldMesh->SetUsingAbsoluteRotation(true);
+	FarFieldMesh->SetUsingAbsoluteScale(true);
+	FarFieldMesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	FarFieldProvider = nullptr;
+	NextFarFieldSection = 0;
+	bFarFieldProxy = false;
+	FarFieldRing = 4;
+	FarFieldChunkSections = 8;
+	FarFieldResolution = 8;
+	FarFieldMaxBuilds = 2;
+	FarFieldSkirtDepth = 2000.0f;
+
+	PrimaryActorTick.bCanEverTick = true;
+	//bAllowTickBeforeBeginPlay = false;
+	//Ticks every frame to dispatch jobs, the grid itself is only updated every GenerationInterval
+	GenerationInterval = 0.5f;
+	GenerationTimer = 0.0f;
+	MaxConcurrentJobs = 0;
+	bFastStartWarmUp = false;
+	PrefetchHorizon = 0.0f;
+	PrefetchMaxSections = 2.0f;
+	bWarmingUp = false;
+	WarmupTotalSections = 0;
+	WarmupCompletedSections = 0;
+
+	GenerationLevel = 1;
+	
+	LandscapeSectionSize = FVector2D(45000.0, 45000.0);
+	LandscapeUVScale = FVector2D(5, 5);
+	LandscapeComponentSize = FIntPoint(100, 100);
+	MaxSectionCount = 9;
+
+	fNoiseScale = 0.1f;
+	fHeightScale = 1.0f;
+
+	GenerationMode = ETerrainGenerationMode::Grid;
+	QuadtreeDepth = 6;
+	QuadtreeRootExtent = 1;
+	QuadtreeSplitDistance = 1.0f;
+	QuadtreeSkirtDepth = 2000.0f;
+
+	bCollisionOnly = false;
+	bCollisionOnlyOnDedicatedServer = true;
+	CollisionOnlyRadius = 1;
+
+	MaxLODLevel = 4;
+	LODRingDistances = { 1.5f, 3.0f, 4.5f, 6.0f };
+	bGenerateAtRingLOD = false;
+	bProgressiveStreaming = false;
+	TargetTriangleBudget = 0;
+	TerrainMemoryBudgetMB = 0;
+	UploadBudgetMilliseconds = 2.0f;
+	UploadBudgetBytes = 8 * 1024 * 1024;
+	bAdaptiveThrottling = false;
+	TargetFrameMilliseconds = 16.6f;
+	ThrottleInterval = 0.25f;
+	MinConcurrentJobs = 1;
+	MinUploadBudgetScale = 0.25f;
+	MaxSectionsPerPass = 4;
+	MinGenerationInterval = 0.1f;
+	bGenerationBacklog = false;
+	ThrottleTimer = 0.0f;
+	ThrottleUploadScale = 1.0f;
+	bAdaptiveMesh = false;
+	AdaptiveMeshMaxError = 20.0f;
+	TargetVertexBudget = 0;
+	bLODBudgetExceeded = false;
+
+	TerrainHeightTableResolution = 256;
+	TerrainHeightTableMaxError = 0.001f;
+	BakedTerrainHeightCurve = nullptr;
+	BakedTerrainHeightHash = 0;
+	CompiledNoiseGraphHash = 0;
+
+	fLacunarity = 2.3f;
+	fPersistance = 0.6f;
+	Octaves = 4;
+
+	AddFoliage = true;
+	AddCollision = true;
+
+	const ConstructorHelpers::FObjectFinder<UStaticMesh> MeshObj(TEXT("StaticMesh'/Game/Meshes/Sphere.Sphere'"));
+	if(MeshObj.Succeeded())
+		TreeMesh = MeshObj.Object;
+
+	mGenerating = false;
+	bCanGenerate = false;
+}
+
+UMaterialInterface* ALandscapeGenerator::GetMaterial()
+{
+	return LandscapeMat;
+}
+
+
+void ALandscapeGenerator::StartGeneration()
+{
+	//Clients wait for the server's settings so both sides generate the same terrain
+	if (GetNetMode() == NM_Client && !ReplicatedSettings.bValid)
+	{
+		bGenerationRequested = true;
+		return;
+	}
+
+	if (HasAuthority())
+		CaptureReplicatedSettings();
+
+	//The simplex permutation table is global, it must be seeded before any worker samples it
+	USimplexNoiseBPLibrary::setNoiseSeed(NoiseSeed);
+
+	//Coarser LOD grids of a power of two stay powers of two, so checking full resolution covers every LOD
+	if (bAdaptiveMesh && !FTerrainRTIN::SupportsGridSize(LandscapeComponentSize + FIntPoint(1, 1)))
+		UE_LOG(LogLandscapeGenerator, Warning, TEXT("bAdaptiveMesh needs a square power of two LandscapeComponentSize, %dx%d sections use the uniform grid"), LandscapeComponentSize.X, LandscapeComponentSize.Y);
+
+	if (UseQuadtree() && (TargetTriangleBudget > 0 || TargetVertexBudget > 0))
+		UE_LOG(LogLandscapeGenerator, Warning, TEXT("TargetTriangleBudget and TargetVertexBudget only apply in grid mode, the quadtree ignores them"));
+
+	RefreshTerrainHeightTable();
+	RefreshNoiseGraph();
+	UpdateQueryNoiseParameters();
+	if (!Deformation.IsValid())
+		Deformation = MakeShared<FTerrainDeformation, ESPMode::ThreadSafe>(LandscapeSectionSize / FVector2D(LandscapeComponentSize), LandscapeComponentSize);
+	bCanGenerate = true;
+	MemoryStats = FTerrainMemoryStats();
+	ThrottleStats = FTerrainThrottleStats();
+	ThrottleStats.JobLimit = CalcMaxJobs();
+	ThrottleStats.SectionsPerPass = 1;
+	ThrottleStats.GenerationInterval = GenerationInterval;
+	bGenerationBacklog = false;
+	ThrottleUploadScale = 1.0f;
+	ThrottleTimer = 0.0f;
+	if (LandscapeMat)
+		FarFieldMesh->SetMaterial(0, LandscapeMat);
+
+	if (bFastStartWarmUp)
+		BeginWarmup();
+}
+
+void ALandscapeGenerator::CaptureReplicatedSettings()
+{
+	ReplicatedSettings.bValid = true;
+	ReplicatedSettings.NoiseSeed = NoiseSeed;
+	ReplicatedSettings.NoiseScale = fNoiseScale;
+	ReplicatedSettings.HeightScale = fHeightScale;
+	ReplicatedSettings.Lacunarity = fLacunarity;
+	ReplicatedSettings.Persistance = fPersistance;
+	ReplicatedSettings.Octaves = Octaves;
+	ReplicatedSettings.TerrainHeight = TerrainHeight;
+	ReplicatedSettings.NoiseGraph = NoiseGraph;
+	ReplicatedSettings.Erosion = Erosion;
+	ReplicatedSettings.LandscapeSectionSize = LandscapeSectionSize;
+	ReplicatedSettings.LandscapeComponentSize = LandscapeComponentSize;
+}
+
+void ALandscapeGenerator::OnRep_ReplicatedSettings()
+{
+	if (!ReplicatedSettings.bValid || HasAuthority())
+		return;
+
+	//Settings only change before generation starts, sections already spawned keep what they were created with
+	NoiseSeed = ReplicatedSettings.NoiseSeed;
+	fNoiseScale = ReplicatedSettings.NoiseScale;
+	fHeightScale = ReplicatedSettings.HeightScale;
+	fLacunarity = ReplicatedSettings.Lacunarity;
+	fPersistance = ReplicatedSettings.Persistance;
+	Octaves = ReplicatedSettings.Octaves;
+	TerrainHeight = ReplicatedSettings.TerrainHeight;
+	NoiseGraph = ReplicatedSettings.NoiseGraph;
+	Erosion = ReplicatedSettings.Erosion;
+	LandscapeSectionSize = ReplicatedSettings.LandscapeSectionSize;
+	LandscapeComponentSize = ReplicatedSettings.LandscapeComponentSize;
+
+	if (bGenerationRequested)
+	{
+		bGenerationRequested = false;
+		StartGeneration();
+	}
+}
+
+void ALandscapeGenerator::RecordSectionChecksum(const FTerrainSectionChecksum& SectionChecksum)
+{
+	if (GetNetMode() == NM_Standalone)
+		return;
+
+	if (HasAuthority())
+	{
+		//A section generated again reuses its slot, otherwise the oldest slot is overwritten
+		int32* Existing = ServerChecksumIndices.Find(SectionChecksum.Node);
+		int32 Index;
+		if (Existing)
+			Index = *Existing;
+		else if (ServerChecksums.Num() < FMath::Max(MaxReplicatedChecksums, 1))
+			Index = ServerChecksums.AddDefaulted();
+		else
+		{
+			Index = NextServerChecksum;
+			NextServerChecksum = (NextServerChecksum + 1) % ServerChecksums.Num();
+			ServerChecksumIndices.Remove(ServerChecksums[Index].Node);
+		}
+
+		ServerChecksums[Index] = SectionChecksum;
+		ServerChecksumIndices.Add(SectionChecksum.Node, Index);
+		return;
+	}
+
+	LocalChecksums.Add(SectionChecksum.Node, SectionChecksum);
+	CompareChecksums(SectionChecksum.Node);
+}
+
+void ALandscapeGenerator::OnRep_ServerChecksums()
+{
+	RemoteChecksums.Reset();
+	for (const FTerrainSectionChecksum& Entry : ServerChecksums)
+		RemoteChecksums.Add(Entry.Node, Entry);
+
+	for (const FTerrainSectionChecksum& Entry : ServerChecksums)
+		CompareChecksums(Entry.Node);
+}
+
+void ALandscapeGenerator::CompareChecksums(const FIntVector& Node)
+{
+	const FTerrainSectionChecksum* Local = LocalChecksums.Find(Node);
+	const FTerrainSectionChecksum* Remote = RemoteChecksums.Find(Node);
+	if (!Local || !Remote)
+		return;
+
+	bool bHeightsDiverged = Local->HeightChecksum != Remote->HeightChecksum;
+	bool bPointsDiverged = Local->PointsChecksum != Remote->PointsChecksum;
+	LocalChecksums.Remove(Node);
+	if (bHeightsDiverged)
+		UE_LOG(LogLandscapeGenerator, Warning, TEXT("Terrain heights of node %s differ from the server"), *Node.ToString());
+	if (bPointsDiverged)
+		UE_LOG(LogLandscapeGenerator, Warning, TEXT("Foliage points of node %s differ from the server"), *Node.ToString());
+	if (bHeightsDiverged || bPointsDiverged)
+		OnTerrainDivergence.Broadcast(Node);
+}
+
+void ALandscapeGenerator::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(ALandscapeGenerator, ReplicatedSettings);
+	DOREPLIFETIME(ALandscapeGenerator, ServerChecksums);
+}
 
 // Called when the game starts or when spawned
 void ALandscapeGenerator::BeginPlay()
 {
 	Super::BeginPlay();
+
+	//Nothing is drawn on a dedicated server
+	if (!IsRunningDedicatedServer())
+	{
+		FarFieldProvider = NewObject<URuntimeMeshProviderStatic>(this, TEXT("FarFieldProvider"));
+		FarFieldMesh->Initialize(FarFieldProvider);
+	}
 }
 
 // Called every frame
@@ -231,7 +1656,32 @@ void ALandscapeGenerator::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
-	if(bCanGenerate)
+	if (!bCanGenerate)
+		return;
+
+	RefreshTerrainHeightTable();
+	RefreshNoiseGraph();
+
+	UpdateThrottling(DeltaTime);
+	ProcessUploadQueue();
+	ProcessFarField();
+	DispatchPendingOperations();
+	EnforceMemoryBudget();
+
+	if (bWarmingUp)
+	{
+		UpdateWarmup();
+		return;
+	}
+
+	GenerationTimer += DeltaTime;
+	if (GenerationTimer < ThrottleStats.GenerationInterval)
+		return;
+
+	GenerationTimer = 0.0f;
+	if (UseQuadtree())
+		GenerateNewQuadtreeNodes();
+	else
 		GenerateNewTerrainGrid();
 }
 
@@ -3,11 +3,12 @@
 
 #include "LandscapeSection.h"
 #include "LandscapeGenerator.h"
-#include "SimplexNoise/Public/SimplexNoiseBPLibrary.h"
 #include "Components/HierarchicalInstancedStaticMeshComponent.h"
 #include "Components/RuntimeMeshComponentStatic.h"
 #include "Providers/RuntimeMeshProviderStatic.h"
 #include "DiskSampler.h"
+#include "TerrainRTIN.h"
+#include "Async/Async.h"
 
 #define LOCTEXT_NAMESPACE "Section"
 
@@ -22,6 +23,19 @@ ALandscapeSection::ALandscapeSection()
 	PointsGenerated = false;
 	CollisionGenerated = false;
 	GeneratingCollision = false;
+	GeneratingLOD = false;
+	bOperationRunning = false;
+	PendingUploads = 0;
+	bMeshDataEvicted = false;
+	bDeformationPending = false;
+	PendingFoliageRect.Init();
+	mHeightChecksum = 0;
+	mPointsChecksum = 0;
+	bChecksumPending = false;
+	bPointsChecksumValid = false;
+	MeshDataLastUsed = 0.0;
+	LODDataLastUsed = 0.0;
+	CollisionLastUsed = 0.0;
 	Points = nullptr;
 
 	mesh = CreateDefaultSubobject<URuntimeMeshComponent>(TEXT("LandscapeMesh"));
@@ -59,13 +73,52 @@ int CalcIndexFromGridPos(const FIntPoint& gridSize, int x, int y)
 	return x + y * gridSize.X;
 }
 
+int64 CalcFoliageSeed(int32 Seed, const FIntPoint& TerrainCoords)
+{
+	return (Seed % (TerrainCoords.X == 0 ? 50 : TerrainCoords.X)) + TerrainCoords.Y;
+}
+
+int CalcLODGridSize(int Components, int LOD)
+{
+	int Skip = 1 << LOD;
+	return FMath::DivideAndRoundUp(Components, Skip) + 1;
+}
+
+int CalcLODSampleIndex(int Components, int LOD, int GridIndex)
+{
+	int Skip = 1 << LOD;
+
+	//The last cell is narrower when the components aren't a multiple of the skip, mirror it on the low side
+	if (GridIndex < 0)
+	{
+		int Remainder = Components % Skip;
+		return Remainder == 0 ? -Skip : -Remainder;
+	}
+
+	if (GridIndex >= CalcLODGridSize(Components, LOD))
+		return Components + FMath::Min(Skip, Components);
+
+	return FMath::Min(GridIndex * Skip, Components);
+}
+
+int CalcLODGridIndexFromSample(int Components, int LOD, int SampleIndex)
+{
+	if (SampleIndex >= Components)
+		return CalcLODGridSize(Components, LOD) - 1;
+
+	return SampleIndex >> LOD;
+}
+
 FVector3f ALandscapeSection::CalculateVertexPosition(float xPos, float yPos)
 {
 	FVector3f vertPosition(xPos, yPos, 0.0f);
 	vertPosition += FVector3f(mMeshOrigin);
 
-	float RawNoiseValue = USimplexNoiseBPLibrary::GetSimplexNoise2D_EX(vertPosition.X * mNoiseScale, vertPosition.Y * mNoiseScale, mLacunarity, mPersistance, mOctaves, 1.0f, true);
-	vertPosition += FVector3f(0.0, 0.0, mLandscapeGen->ApplyTerrainHeightMultiplier(RawNoiseValue) * mHeightScale);
+	vertPosition.Z += mNoiseParams.CalculateBaseHeight(vertPosition.X, vertPosition.Y);
+	if (mNoiseParams.Erosion.IsValid() && mNodeLevel == 0)
+		vertPosition.Z += mNoiseParams.Erosion->SampleDelta(FVector2D(vertPosition.X, vertPosition.Y), mNoiseParams, &mErosionTiles);
+	if (mDeltaTiles.Tiles.Num() > 0)
+		vertPosition.Z += mDeltaTiles.GetDelta(mDeformation->WorldToLattice(FVector2D(vertPosition.X, vertPosition.Y)));
 
 	return vertPosition;
 }
@@ -73,31 +126,25 @@ FVector3f ALandscapeSection::CalculateVertexPosition(float xPos, float yPos)
 void ALandscapeSection::GenerateFoliage()
 {
 
-	if (!bMeshGenerated || !PointsGenerated)
+	//Only the heightfield is sampled so foliage can be placed even after the mesh data was evicted
+	if (!mHeightfield.IsValid() || !PointsGenerated)
 		return;
 
 	FoliageGenerated = true;
 	if (!mLandscapeGen->AddFoliage)
 		return;
 	
-	FCollisionQueryParams Params;
-	Params.bTraceComplex = true;
-	Params.AddIgnoredComponent(InstMesh);
-	FHitResult Res;
-	
-	for (FVector2D Point : Points->PointList)
+	//Sample the section's own heightfield instead of tracing against its collision
+	mFoliagePointIndices.Reset();
+	for (int PointIndex = 0; PointIndex < Points->PointList.Num(); PointIndex++)
 	{
-		FVector Start = FVector(Point, mHeightScale + 3000.0f) + mMeshOrigin;
-		FVector End = FVector(Point, -3000.0f) + mMeshOrigin;
-		
-		bool bHit = GetWorld()->LineTraceSingleByChannel(Res, Start, End, ECollisionChannel::ECC_Visibility, Params);
-		if (bHit)
+		FVector2D WorldPoint = Points->PointList[PointIndex] + FVector2D(mMeshOrigin);
+		float Height = mHeightfield->SampleHeight(WorldPoint);
+		if (Height < FOLIAGE_MAX_HEIGHT)
 		{
-			if (Res.ImpactPoint.Z < 6000)
-			{
-				FTransform InstTransform(Res.ImpactPoint);
-				InstMesh->AddInstance(InstTransform, true);
-			}
+			FTransform InstTransform(FVector(WorldPoint, Height));
+			InstMesh->AddInstance(InstTransform, true);
+			mFoliagePointIndices.Add(PointIndex);
 		}
 	}
 
@@ -107,6 +154,7 @@ void ALandscapeSection::GenerateFoliage()
 void ALandscapeSection::RemoveFoliage()
 {
 	InstMesh->ClearInstances();
+	mFoliagePointIndices.Reset();
 	FoliageGenerated = false;
 }
 
@@ -115,23 +163,30 @@ bool ALandscapeSection::IsOriginCoord(const FVector& PlayerLocation)
 	return mLandscapeGen->GetCurrentGridPoint(PlayerLocation) == mTerrainCoords;
 }
 
-void ALandscapeSection::InitialiseSection(ALandscapeGenerator* LandscapeGen, FIntPoint TerrainCoords, uint32 Seed, const FVector2D& SectionSize, const FIntPoint& ComponentsPerAxis, float fNoiseScale, float fHeightScale, float fLacunarity, float fPersistance, int Octaves)
+void ALandscapeSection::InitialiseSection(ALandscapeGenerator* LandscapeGen, FIntPoint TerrainCoords, uint32 Seed, const FVector2D& SectionSize, const FIntPoint& ComponentsPerAxis, const FTerrainNoiseParameters& NoiseParams, int InitialLOD, int NodeLevel)
 {
 	mLandscapeGen = LandscapeGen;
 	mTerrainCoords = TerrainCoords;
+	mNodeLevel = NodeLevel;
+	mCollisionOnly = mLandscapeGen->IsCollisionOnly();
+
+	//Quadtree nodes of different sizes meet with T-junctions, hide the cracks with skirts
+	mSkirtDepth = mLandscapeGen->GenerationMode == ETerrainGenerationMode::Quadtree ? mLandscapeGen->QuadtreeSkirtDepth : 0.0f;
 
 	bMeshGenerated = false;
 	LODLevel = -1;
+	TargetLOD = -1;
+	SourceRefCount = 0;
 	GenLOD = -1;
+	MeshDataLOD = InitialLOD;
+	SampledLOD = -1;
+	CollisionLOD = -1;
 
 	mSectionSize = SectionSize;
 	mComponentsPerAxis = ComponentsPerAxis;
-	mHeightScale = fHeightScale;
-	mNoiseScale = fNoiseScale;
-	mLacunarity = fLacunarity;
-	mPersistance = fPersistance;
-	mOctaves = Octaves;
+	mNoiseParams = NoiseParams;
 	GlobalSeed = Seed;
+	mDeformation = mLandscapeGen->GetDeformation();
 
 	UStaticMesh* treeMesh = mLandscapeGen->TreeMesh;
 	if (treeMesh)
@@ -139,8 +194,11 @@ void ALandscapeSection::InitialiseSection(ALandscapeGenerator* LandscapeGen, FIn
 
 	InstMesh->SetMobility(EComponentMobility::Static);
 
-	Thread = new FGeneratorThread(this);
-	Thread->StartOperation(THREAD_OPERATION::GEN_LANDSCAPE);
+	mMeshOrigin = FVector(CalculateWorldCoordinatesFromTerrainCoords(mTerrainCoords, mSectionSize), 0.0);
+	bOperationPending = false;
+
+	Thread = new FGeneratorThread(this, &mLandscapeGen->ActiveJobs);
+	StartOperation(THREAD_OPERATION::GEN_LANDSCAPE);
 
 }
 
@@ -151,70 +209,163 @@ void ALandscapeSection::GenerateSectionMeshData()
 	float rowVertDist = mSectionSize.Y / mComponentsPerAxis.Y;
 	float columnVertDist = mSectionSize.X / mComponentsPerAxis.X;
 
-	FIntPoint OverallComponents = mComponentsPerAxis + FIntPoint(1, 1);
+	//Erode the tiles under the section up front, in parallel, instead of one at a time from the vertex loop
+	if (mNoiseParams.Erosion.IsValid() && mNodeLevel == 0 && mErosionTiles.Tiles.Num() == 0)
+		mErosionTiles = mNoiseParams.Erosion->GatherTiles(FVector2D(MeshOrigin), FVector2D(MeshOrigin) + mSectionSize, mNoiseParams);
+
+	//Deltas are read from a snapshot so the vertex loop never takes the deformation lock
+	if (mDeformation.IsValid())
+		mDeltaTiles = mDeformation->GatherTiles(CalcSectionLatticeRect(1 << (mNodeLevel + MeshDataLOD)));
+
+	//Mesh data is only generated at the resolution the section needs
+	FIntPoint OverallComponents(CalcLODGridSize(mComponentsPerAxis.X, MeshDataLOD), CalcLODGridSize(mComponentsPerAxis.Y, MeshDataLOD));
+
+	//When refining, the previously sampled coarse grid is a subset of the finer one so its samples are reused
+	TArray<FVector3f> CoarseVertices;
+	int CoarseLOD = SampledLOD;
+	int CoarseSkip = 0;
+	FIntPoint CoarseComponents;
+	if (CoarseLOD > MeshDataLOD && mSectionVertices.Num() > 0)
+	{
+		CoarseVertices = MoveTemp(mSectionVertices);
+		CoarseSkip = 1 << CoarseLOD;
+		CoarseComponents = FIntPoint(CalcLODGridSize(mComponentsPerAxis.X, CoarseLOD), CalcLODGridSize(mComponentsPerAxis.Y, CoarseLOD));
+	}
+
+	mSectionVertices.Reset();
+	mSectionIndices.Reset();
+	mSectionNormals.Reset();
+	mSectionVertices.Reserve(OverallComponents.X * OverallComponents.Y);
 
 	//Generate Vertices
 	for (int j = 0; j < OverallComponents.Y; j++)
 	{
-		float yPos = rowVertDist * j;
+		int SampleY = CalcLODSampleIndex(mComponentsPerAxis.Y, MeshDataLOD, j);
+		float yPos = rowVertDist * SampleY;
+		bool bCoarseRow = CoarseSkip > 0 && (SampleY % CoarseSkip == 0 || SampleY == mComponentsPerAxis.Y);
 		for (int i = 0; i < OverallComponents.X; i++)
 		{
 			//Generate vertex
-			float xPos = columnVertDist * i;
-			FVector3f VertexPos = CalculateVertexPosition(xPos, yPos);
+			int SampleX = CalcLODSampleIndex(mComponentsPerAxis.X, MeshDataLOD, i);
+			float xPos = columnVertDist * SampleX;
+			FVector3f VertexPos;
+			if (bCoarseRow && (SampleX % CoarseSkip == 0 || SampleX == mComponentsPerAxis.X))
+			{
+				int CoarseX = CalcLODGridIndexFromSample(mComponentsPerAxis.X, CoarseLOD, SampleX);
+				int CoarseY = CalcLODGridIndexFromSample(mComponentsPerAxis.Y, CoarseLOD, SampleY);
+				VertexPos = CoarseVertices[CalcIndexFromGridPos(CoarseComponents, CoarseX, CoarseY)];
+			}
+			else
+				VertexPos = CalculateVertexPosition(xPos, yPos);
+
 			mSectionVertices.Add(VertexPos);
+		}
+	}
 
-			//Generate Indices
-			if ((i < OverallComponents.X - 1) && (j < OverallComponents.Y - 1))
-			{
-				//Generate Triangle Index
-				int index11 = CalcIndexFromGridPos(OverallComponents, i, j);
-				int index12 = CalcIndexFromGridPos(OverallComponents, i, j + 1);
-				int index13 = CalcIndexFromGridPos(OverallComponents, i + 1, j + 1);
+	//Collision only sections never render so they don't need indices or normals
+	if (!mCollisionOnly)
+	{
+		TriangulateGrid(mSectionVertices, OverallComponents, MeshDataLOD, mSectionIndices);
+		GenerateSectionNormals(OverallComponents);
+	}
+
+	BuildHeightfield(OverallComponents);
+
+	if (mSkirtDepth > 0.0f && !mCollisionOnly)
+		AppendSectionSkirt(OverallComponents);
 
-				int index22 = CalcIndexFromGridPos(OverallComponents, i + 1, j + 1);
-				int index23 = CalcIndexFromGridPos(OverallComponents, i + 1, j);
+	SampledLOD = MeshDataLOD;
 
-				mSectionIndices.Add(index11);
-				mSectionIndices.Add(index12);
-				mSectionIndices.Add(index13);
+	//Foliage is only placed on full resolution base sized sections, or on collision only sections when it has collision
+	bool bNeedsPoints = mCollisionOnly ? mLandscapeGen->AddFoliage : MeshDataLOD == 0;
+	if (bNeedsPoints && mNodeLevel == 0 && !PointsGenerated)
+	{
+		Points = NewObject<UDiskSampler>(GetTransientPackage(), UDiskSampler::StaticClass());
+
+		Points->GeneratePoints(CalcFoliageSeed(GlobalSeed, mTerrainCoords), mSectionSize.X, mSectionSize.Y, FOLIAGE_POINT_RADIUS, FOLIAGE_POINT_ATTEMPTS);
+		PointsGenerated = true;
+	}
 
-				mSectionIndices.Add(index11);
-				mSectionIndices.Add(index22);
-				mSectionIndices.Add(index23);
+	//Runtime deformation is local to each process, only the procedural terrain is compared
+	if (mDeltaTiles.Tiles.Num() == 0)
+	{
+		//Sampled on a fixed lattice so server and clients agree whatever LOD they generated the section at
+		TArray<float> ReferenceHeights;
+		ReferenceHeights.Reserve(CHECKSUM_LATTICE_SIZE * CHECKSUM_LATTICE_SIZE);
+		for (int j = 0; j < CHECKSUM_LATTICE_SIZE; j++)
+		{
+			for (int i = 0; i < CHECKSUM_LATTICE_SIZE; i++)
+				ReferenceHeights.Add(CalculateVertexPosition(mSectionSize.X * i / (CHECKSUM_LATTICE_SIZE - 1), mSectionSize.Y * j / (CHECKSUM_LATTICE_SIZE - 1)).Z);
+		}
+		mHeightChecksum = FCrc::MemCrc32(ReferenceHeights.GetData(), ReferenceHeights.Num() * sizeof(float));
+
+		//Always derived from the foliage seed, sections that never place foliage still verify their points
+		if (!bPointsChecksumValid)
+		{
+			mPointsChecksum = 0;
+			if (mNodeLevel == 0)
+			{
+				TArray<FVector2D> ReferencePoints;
+				if (PointsGenerated && Points)
+					ReferencePoints = Points->PointList;
+				else
+					UDiskSampler::GeneratePoissonPoints(CalcFoliageSeed(GlobalSeed, mTerrainCoords), mSectionSize.X, mSectionSize.Y, FOLIAGE_POINT_RADIUS, FOLIAGE_POINT_ATTEMPTS, ReferencePoints);
+				mPointsChecksum = FCrc::MemCrc32(ReferencePoints.GetData(), ReferencePoints.Num() * sizeof(FVector2D));
 			}
+			bPointsChecksumValid = true;
 		}
+		bChecksumPending = true;
 	}
 
-	//Use custom method to generate normals to fix seams.
+	MeshDataLastUsed = FPlatformTime::Seconds();
+	bMeshGenerated = true;
+}
+
+void ALandscapeSection::GenerateSectionNormals(const FIntPoint& OverallComponents)
+{
 	mSectionNormals.SetNumZeroed(mSectionVertices.Num());
-	for (int j = -1; j < OverallComponents.Y; j++)
+	UpdateSectionNormals(OverallComponents, FIntRect(0, 0, OverallComponents.X - 1, OverallComponents.Y - 1));
+}
+
+void ALandscapeSection::UpdateSectionNormals(const FIntPoint& OverallComponents, const FIntRect& VertexRect)
+{
+	float rowVertDist = mSectionSize.Y / mComponentsPerAxis.Y;
+	float columnVertDist = mSectionSize.X / mComponentsPerAxis.X;
+
+	for (int j = VertexRect.Min.Y; j <= VertexRect.Max.Y; j++)
+		for (int i = VertexRect.Min.X; i <= VertexRect.Max.X; i++)
+			mSectionNormals[CalcIndexFromGridPos(OverallComponents, i, j)] = FVector3f::ZeroVector;
+
+	auto AddNormal = [this, &OverallComponents, &VertexRect](int i, int j, const FVector3f& Normal)
 	{
-		for (int i = -1; i < OverallComponents.X; i++)
+		if (i >= VertexRect.Min.X && i <= VertexRect.Max.X && j >= VertexRect.Min.Y && j <= VertexRect.Max.Y)
+			mSectionNormals[CalcIndexFromGridPos(OverallComponents, i, j)] += Normal;
+	};
+
+	//Use custom method to generate normals to fix seams.
+	//Every vertex sums the triangles around it, quads outside the grid are sampled so normals match the neighbouring sections
+	for (int j = VertexRect.Min.Y - 1; j <= VertexRect.Max.Y; j++)
+	{
+		for (int i = VertexRect.Min.X - 1; i <= VertexRect.Max.X; i++)
 		{
 			FVector3f vertex1;
 			FVector3f vertex2;
 			FVector3f vertex3;
 			FVector3f vertex4;
 
-			int index11 = CalcIndexFromGridPos(OverallComponents, i, j);
-			int index12 = CalcIndexFromGridPos(OverallComponents, i, j + 1);
-			int index13 = CalcIndexFromGridPos(OverallComponents, i + 1, j + 1);
-			int index23 = CalcIndexFromGridPos(OverallComponents, i + 1, j);
-
 			if ((i > -1 && i < OverallComponents.X - 1) && (j > -1 && j < OverallComponents.Y - 1))
 			{
-				vertex1 = mSectionVertices[index11];
-				vertex2 = mSectionVertices[index12];
-				vertex3 = mSectionVertices[index13];
-				vertex4 = mSectionVertices[index23];
+				vertex1 = mSectionVertices[CalcIndexFromGridPos(OverallComponents, i, j)];
+				vertex2 = mSectionVertices[CalcIndexFromGridPos(OverallComponents, i, j + 1)];
+				vertex3 = mSectionVertices[CalcIndexFromGridPos(OverallComponents, i + 1, j + 1)];
+				vertex4 = mSectionVertices[CalcIndexFromGridPos(OverallComponents, i + 1, j)];
 			}
 			else
 			{
-				float xPos1 = columnVertDist * i;
-				float yPos1 = rowVertDist * j;
-				float yPos2 = rowVertDist * (j + 1);
-				float xPos2 = columnVertDist * (i + 1);
+				float xPos1 = columnVertDist * CalcLODSampleIndex(mComponentsPerAxis.X, MeshDataLOD, i);
+				float yPos1 = rowVertDist * CalcLODSampleIndex(mComponentsPerAxis.Y, MeshDataLOD, j);
+				float yPos2 = rowVertDist * CalcLODSampleIndex(mComponentsPerAxis.Y, MeshDataLOD, j + 1);
+				float xPos2 = columnVertDist * CalcLODSampleIndex(mComponentsPerAxis.X, MeshDataLOD, i + 1);
 
 				vertex1 = CalculateVertexPosition(xPos1, yPos1);
 				vertex2 = CalculateVertexPosition(xPos1, yPos2);
@@ -230,72 +381,113 @@ void ALandscapeSection::GenerateSectionMeshData()
 			dir2 = vertex4 - vertex1;
 			FVector3f normal2 = FVector3f::CrossProduct(dir2, dir1).GetSafeNormal();
 
-			if (i == -1)
-			{
-				if (j == -1)
-				{
-					mSectionNormals[index13] += normal1;
-					mSectionNormals[index13] += normal2;
-				}
-				else if (j == OverallComponents.Y - 1)
-					mSectionNormals[index23] += normal2;
-				else
-				{
-					mSectionNormals[index13] += normal1;
-					mSectionNormals[index13] += normal2;
-					mSectionNormals[index23] += normal2;
-				}
-			}
-			else if (j == -1)
-			{
-				mSectionNormals[index12] += normal1;
-				if (i != OverallComponents.X - 1)
-				{
-					mSectionNormals[index13] += normal1;
-					mSectionNormals[index13] += normal2;
-				}
-			}
-			else if (i == OverallComponents.X - 1)
-			{
-				mSectionNormals[index11] += normal1;
-				mSectionNormals[index11] += normal2;
-				if (j != OverallComponents.Y - 1)
-					mSectionNormals[index12] += normal1;
-			}
-			else if (j == OverallComponents.Y - 1)
-			{
-				mSectionNormals[index11] += normal1;
-				mSectionNormals[index11] += normal2;
-				if (i != OverallComponents.X - 1)
-					mSectionNormals[index23] += normal2;
-			}
-			else
-			{
-				mSectionNormals[index11] += normal1;
-				mSectionNormals[index11] += normal2;
+			AddNormal(i, j, normal1 + normal2);
+			AddNormal(i, j + 1, normal1);
+			AddNormal(i + 1, j + 1, normal1 + normal2);
+			AddNormal(i + 1, j, normal2);
+		}
+	}
 
-				mSectionNormals[index12] += normal1;
-				mSectionNormals[index13] += normal1;
+	//Normalize normals
+	for (int j = VertexRect.Min.Y; j <= VertexRect.Max.Y; j++)
+		for (int i = VertexRect.Min.X; i <= VertexRect.Max.X; i++)
+			mSectionNormals[CalcIndexFromGridPos(OverallComponents, i, j)].Normalize();
+}
 
-				mSectionNormals[index13] += normal2;
-				mSectionNormals[index23] += normal2;
-			}
+void ALandscapeSection::BuildHeightfield(const FIntPoint& GridSize)
+{
+	TSharedPtr<FTerrainHeightfield, ESPMode::ThreadSafe> Heightfield = MakeShared<FTerrainHeightfield, ESPMode::ThreadSafe>();
+	Heightfield->Origin = FVector2D(mMeshOrigin);
+	Heightfield->VertexSpacing = mSectionSize / FVector2D(mComponentsPerAxis);
+	Heightfield->Components = mComponentsPerAxis;
+	Heightfield->LOD = MeshDataLOD;
+	Heightfield->GridSize = GridSize;
+	Heightfield->Heights.SetNumUninitialized(GridSize.X * GridSize.Y);
+	for (int i = 0; i < Heightfield->Heights.Num(); i++)
+		Heightfield->Heights[i] = mSectionVertices[i].Z;
+	Heightfield->BuildHeightRanges();
+
+	mHeightfield = Heightfield;
+	mLandscapeGen->PublishHeightfield(FIntVector(mTerrainCoords.X, mTerrainCoords.Y, mNodeLevel), mHeightfield);
+}
 
-		}
+void ALandscapeSection::AppendSectionSkirt(const FIntPoint& GridSize)
+{
+	//Walk the border of the grid once, every border vertex gets a copy pushed down by the skirt depth
+	TArray<int32> BorderIndices;
+	for (int i = 0; i < GridSize.X; i++)
+		BorderIndices.Add(CalcIndexFromGridPos(GridSize, i, 0));
+	for (int j = 1; j < GridSize.Y; j++)
+		BorderIndices.Add(CalcIndexFromGridPos(GridSize, GridSize.X - 1, j));
+	for (int i = GridSize.X - 2; i >= 0; i--)
+		BorderIndices.Add(CalcIndexFromGridPos(GridSize, i, GridSize.Y - 1));
+	for (int j = GridSize.Y - 2; j >= 0; j--)
+		BorderIndices.Add(CalcIndexFromGridPos(GridSize, 0, j));
+
+	mSkirtSourceIndices = BorderIndices;
+	int SkirtStart = mSectionVertices.Num();
+	for (int32 BorderIndex : BorderIndices)
+	{
+		mSectionVertices.Add(mSectionVertices[BorderIndex] - FVector3f(0.0f, 0.0f, mSkirtDepth));
+		mSectionNormals.Add(mSectionNormals[BorderIndex]);
 	}
 
-	//Normalize normals
-	for (int i = 0; i < mSectionNormals.Num(); i += 1)
-		mSectionNormals[i].Normalize();
+	//Skirts are thin, emit both windings so they hide cracks from either side
+	for (int k = 0; k < BorderIndices.Num() - 1; k++)
+	{
+		int Top1 = BorderIndices[k];
+		int Top2 = BorderIndices[k + 1];
+		int Bottom1 = SkirtStart + k;
+		int Bottom2 = SkirtStart + k + 1;
+
+		mSectionIndices.Add(Top1);
+		mSectionIndices.Add(Bottom1);
+		mSectionIndices.Add(Top2);
+		mSectionIndices.Add(Top2);
+		mSectionIndices.Add(Bottom1);
+		mSectionIndices.Add(Bottom2);
+
+		mSectionIndices.Add(Top1);
+		mSectionIndices.Add(Top2);
+		mSectionIndices.Add(Bottom1);
+		mSectionIndices.Add(Top2);
+		mSectionIndices.Add(Bottom2);
+		mSectionIndices.Add(Bottom1);
+	}
+}
 
-	bMeshGenerated = true;
+void ALandscapeSection::TriangulateGrid(const TArray<FVector3f>& GridVertices, const FIntPoint& GridSize, int LOD, TArray<int32>& OutIndices) const
+{
+	if (mLandscapeGen->bAdaptiveMesh && FTerrainRTIN::SupportsGridSize(GridSize))
+	{
+		//Coarser grids have wider spacing, the allowed error grows with it
+		FTerrainRTIN RTIN(GridVertices, GridSize.X);
+		RTIN.Triangulate(mLandscapeGen->AdaptiveMeshMaxError * (1 << (LOD + mNodeLevel)), OutIndices);
+		return;
+	}
 
-	Points = NewObject<UDiskSampler>(GetTransientPackage(), UDiskSampler::StaticClass());
+	OutIndices.Reserve(OutIndices.Num() + (GridSize.X - 1) * (GridSize.Y - 1) * 6);
+	for (int j = 0; j < GridSize.Y - 1; j++)
+	{
+		for (int i = 0; i < GridSize.X - 1; i++)
+		{
+			//Generate Triangle Index
+			int index11 = CalcIndexFromGridPos(GridSize, i, j);
+			int index12 = CalcIndexFromGridPos(GridSize, i, j + 1);
+			int index13 = CalcIndexFromGridPos(GridSize, i + 1, j + 1);
+
+			int index22 = CalcIndexFromGridPos(GridSize, i + 1, j + 1);
+			int index23 = CalcIndexFromGridPos(GridSize, i + 1, j);
 
-	int64 seed = (GlobalSeed % (mTerrainCoords.X == 0 ? 50 : mTerrainCoords.X)) + mTerrainCoords.Y;
+			OutIndices.Add(index11);
+			OutIndices.Add(index12);
+			OutIndices.Add(index13);
 
-	Points->GeneratePoints(seed, mSectionSize.X, mSectionSize.Y, 1100, 10);
-	PointsGenerated = true;
+			OutIndices.Add(index11);
+			OutIndices.Add(index22);
+			OutIndices.Add(index23);
+		}
+	}
 }
 
 bool ALandscapeSection::GenerateCollisionFromLOD(int LOD)
@@ -303,32 +495,54 @@ bool ALandscapeSection::GenerateCollisionFromLOD(int LOD)
 	if (!bMeshGenerated)
 		return false;
 
-	int Skip = FMath::Floor(FMath::Pow(2, LOD));
+	//Collision can't be finer than the generated mesh data
+	LOD = FMath::Max(LOD, MeshDataLOD);
+	CollisionData = FRuntimeMeshCollisionData();
+	mCollisionVertices.Reset();
+	mCollisionSourceIndices.Reset();
+	TArray<int32> GridSourceIndices;
 
-	FIntPoint ActualComponents = mComponentsPerAxis / Skip + FIntPoint(1, 1);
+	FIntPoint DataComponents(CalcLODGridSize(mComponentsPerAxis.X, MeshDataLOD), CalcLODGridSize(mComponentsPerAxis.Y, MeshDataLOD));
+	FIntPoint ActualComponents(CalcLODGridSize(mComponentsPerAxis.X, LOD), CalcLODGridSize(mComponentsPerAxis.Y, LOD));
 
 	for (int j = 0; j < ActualComponents.Y; j++)
 	{
+		int DataY = CalcLODGridIndexFromSample(mComponentsPerAxis.Y, MeshDataLOD, CalcLODSampleIndex(mComponentsPerAxis.Y, LOD, j));
 		for (int i = 0; i < ActualComponents.X; i++)
 		{
-			int vertindex = CalcIndexFromGridPos(mComponentsPerAxis + FIntPoint(1, 1), i, j);
-			CollisionData.Vertices.Add(mSectionVertices[vertindex * Skip]);
-
-			if ((i < ActualComponents.X - 1) && (j < ActualComponents.Y - 1))
-			{
-				int index11 = CalcIndexFromGridPos(ActualComponents, i, j);
-				int index12 = CalcIndexFromGridPos(ActualComponents, i, j + 1);
-				int index13 = CalcIndexFromGridPos(ActualComponents, i + 1, j + 1);
+			int DataX = CalcLODGridIndexFromSample(mComponentsPerAxis.X, MeshDataLOD, CalcLODSampleIndex(mComponentsPerAxis.X, LOD, i));
+			int vertindex = CalcIndexFromGridPos(DataComponents, DataX, DataY);
+			mCollisionVertices.Add(mSectionVertices[vertindex]);
+			GridSourceIndices.Add(vertindex);
+		}
+	}
 
-				int index22 = CalcIndexFromGridPos(ActualComponents, i + 1, j + 1);
-				int index23 = CalcIndexFromGridPos(ActualComponents, i + 1, j);
+	TArray<int32> CollisionIndices;
+	TriangulateGrid(mCollisionVertices, ActualComponents, LOD, CollisionIndices);
 
-				CollisionData.Triangles.Add(index11, index12, index13);
-				CollisionData.Triangles.Add(index11, index22, index23);
-			}
+	//Adaptive triangulation leaves grid vertices unused, only the referenced ones are handed to the physics cooker
+	TArray<int32> VertexRemap;
+	VertexRemap.Init(INDEX_NONE, mCollisionVertices.Num());
+	for (int32& Index : CollisionIndices)
+	{
+		if (VertexRemap[Index] == INDEX_NONE)
+		{
+			VertexRemap[Index] = CollisionData.Vertices.Num();
+			CollisionData.Vertices.Add(mCollisionVertices[Index]);
+			mCollisionSourceIndices.Add(GridSourceIndices[Index]);
 		}
+
+		Index = VertexRemap[Index];
 	}
+
+	for (int i = 0; i < CollisionIndices.Num(); i += 3)
+		CollisionData.Triangles.Add(CollisionIndices[i], CollisionIndices[i + 1], CollisionIndices[i + 2]);
+
+	mCollisionVertices.Empty();
 	
+	CollisionLOD = LOD;
+	CollisionLastUsed = FPlatformTime::Seconds();
+	MeshDataLastUsed = CollisionLastUsed;
 	CollisionGenerated = true;
 	GeneratingCollision = false;
 	return true;
@@ -344,146 +558,597 @@ bool ALandscapeSection::GenerateLODData(int LOD)
 	mSectionLODVertices.Empty();
 	mSectionLODNormals.Empty();
 	mSectionLODIndices.Empty();
+	mLODSourceIndices.Empty();
 
-	int Skip = FMath::Floor(FMath::Pow(2, LOD));
-
-	FIntPoint ActualComponents = mComponentsPerAxis / Skip + FIntPoint(1, 1);
+	//LODs are subsampled from the generated mesh data which may itself be coarser than full resolution
+	FIntPoint DataComponents(CalcLODGridSize(mComponentsPerAxis.X, MeshDataLOD), CalcLODGridSize(mComponentsPerAxis.Y, MeshDataLOD));
+	FIntPoint ActualComponents(CalcLODGridSize(mComponentsPerAxis.X, LOD), CalcLODGridSize(mComponentsPerAxis.Y, LOD));
 
 	for (int j = 0; j < ActualComponents.Y; j++)
 	{
+		int DataY = CalcLODGridIndexFromSample(mComponentsPerAxis.Y, MeshDataLOD, CalcLODSampleIndex(mComponentsPerAxis.Y, LOD, j));
 		for (int i = 0; i < ActualComponents.X; i++)
 		{
-			int vertindex = CalcIndexFromGridPos(mComponentsPerAxis + FIntPoint(1, 1), i, j);
-			mSectionLODVertices.Add(mSectionVertices[vertindex * Skip]);
-			mSectionLODNormals.Add(mSectionNormals[vertindex * Skip]);
+			int DataX = CalcLODGridIndexFromSample(mComponentsPerAxis.X, MeshDataLOD, CalcLODSampleIndex(mComponentsPerAxis.X, LOD, i));
+			int vertindex = CalcIndexFromGridPos(DataComponents, DataX, DataY);
+			mSectionLODVertices.Add(mSectionVertices[vertindex]);
+			mSectionLODNormals.Add(mSectionNormals[vertindex]);
+			mLODSourceIndices.Add(vertindex);
+		}
+	}
 
-			if ((i < ActualComponents.X - 1) && (j < ActualComponents.Y - 1))
-			{
-				int index11 = CalcIndexFromGridPos(ActualComponents, i, j);
-				int index12 = CalcIndexFromGridPos(ActualComponents, i, j + 1);
-				int index13 = CalcIndexFromGridPos(ActualComponents, i + 1, j + 1);
+	TriangulateGrid(mSectionLODVertices, ActualComponents, LOD, mSectionLODIndices);
 
-				int index22 = CalcIndexFromGridPos(ActualComponents, i + 1, j + 1);
-				int index23 = CalcIndexFromGridPos(ActualComponents, i + 1, j);
+	LODDataLastUsed = FPlatformTime::Seconds();
+	MeshDataLastUsed = LODDataLastUsed;
+	GeneratingLOD = false;
+	return true;
+}
 
-				mSectionLODIndices.Add(index11);
-				mSectionLODIndices.Add(index12);
-				mSectionLODIndices.Add(index13);
+void ALandscapeSection::UpdateCollisionOnlySection(int LOD)
+{
+	if (!bMeshGenerated || GeneratingCollision || LODLevel == LOD)
+		return;
 
-				mSectionLODIndices.Add(index11);
-				mSectionLODIndices.Add(index22);
-				mSectionLODIndices.Add(index23);
-			}
-		}
+	if (!CollisionGenerated)
+	{
+		GeneratingCollision = true;
+		StartOperation(GEN_COLLISION);
+		return;
 	}
 
-	GeneratingLOD = false;
-	return true;
+	//Collision is submitted once, nothing is ever uploaded for rendering
+	LODLevel = LOD;
+	CollisionLastUsed = FPlatformTime::Seconds();
+	mLandscapeGen->EnqueueUpload(this, ETerrainUploadType::Collision, GetMemoryUsage(ETerrainMemoryCategory::CollisionData), [this]()
+	{
+		CollisionProvider->SetCollisionMesh(CollisionData);
+		mesh->SetCollisionEnabled(ECollisionEnabled::QueryAndPhysics);
+	});
+
+	if (!FoliageGenerated)
+		mLandscapeGen->EnqueueUpload(this, ETerrainUploadType::Foliage, GetMemoryUsage(ETerrainMemoryCategory::FoliagePoints), [this]() { GenerateFoliage(); });
 }
 
 void ALandscapeSection::UpdateTerrainSection(int LOD)
 {
+	//The worker owns the section data and GenLOD until it finishes, OnOperationFinished continues towards TargetLOD
+	if (bOperationRunning)
+		return;
+
+	//Evicted mesh data is regenerated once the section has to change again, the uploaded mesh stays visible meanwhile
+	if (bMeshDataEvicted)
+	{
+		if (LODLevel == LOD || bOperationPending)
+			return;
+
+		bMeshDataEvicted = false;
+		if (LOD < MeshDataLOD && !mCollisionOnly)
+			MeshDataLOD = FMath::Max(LOD, 0);
+		GenLOD = -1;
+		CollisionGenerated = false;
+		StartOperation(GEN_LANDSCAPE);
+		return;
+	}
+
+	if (mCollisionOnly)
+	{
+		UpdateCollisionOnlySection(LOD);
+		return;
+	}
+
 	if (mesh && bMeshGenerated && !GeneratingCollision)
 	{
-		if (LOD > 4 || LODLevel == LOD)
+		//Display whatever has been generated first so a coarse proxy shows up while finer data is built
+		if (LODLevel < 0 && LOD < MeshDataLOD)
+			LOD = MeshDataLOD;
+
+		if (LOD > mLandscapeGen->MaxLODLevel || LODLevel == LOD)
 			return;
 
-		if (LOD > 0 && GenLOD != LOD)
+		//Section was generated coarser than needed, refine it to the new resolution reusing the coarse samples
+		if (LOD < MeshDataLOD)
 		{
-			GenLOD = LOD;
-			GeneratingLOD = true;
-			Thread->StartOperation(GEN_LOD);
+			if (GeneratingLOD)
+				return;
+
+			MeshDataLOD = LOD;
+			bMeshGenerated = false;
+			CollisionGenerated = false;
+			GenLOD = -1;
+			StartOperation(GEN_LANDSCAPE);
 			return;
 		}
 
-		if (!CollisionGenerated)
+		if (LOD > MeshDataLOD && GenLOD != LOD)
 		{
-			GeneratingCollision = true;
-			Thread->StartOperation(GEN_COLLISION);
+			GenLOD = LOD;
+			GeneratingLOD = true;
+			StartOperation(GEN_LOD);
 			return;
 		}
 
-		CollisionProvider->SetCollisionMesh(CollisionData);
-
-		if (!GeneratingLOD)
+		//Collision is only enabled on full resolution base sized sections
+		if (LOD == 0 && mNodeLevel == 0)
 		{
-			LODLevel = LOD;
-			if (LODLevel > 0)
+			if (!CollisionGenerated)
 			{
-				mesh->SetCollisionEnabled(ECollisionEnabled::NoCollision);
-				StaticProvider->CreateSectionFromComponents(0, 0, 0, mSectionLODVertices, mSectionLODIndices, mSectionLODNormals, TArray<FVector2f>(), TArray<FColor>(), TArray<FRuntimeMeshTangent>(), ERuntimeMeshUpdateFrequency::Infrequent, false);
-				if (FoliageGenerated)
-					RemoveFoliage();
+				GeneratingCollision = true;
+				StartOperation(GEN_COLLISION);
+				return;
 			}
-			else
+
+			CollisionLastUsed = FPlatformTime::Seconds();
+			mLandscapeGen->EnqueueUpload(this, ETerrainUploadType::Collision, GetMemoryUsage(ETerrainMemoryCategory::CollisionData), [this]()
 			{
-				mesh->SetCollisionEnabled(ECollisionEnabled::QueryAndPhysics);
-				StaticProvider->CreateSectionFromComponents(0, 0, 0, mSectionVertices, mSectionIndices, mSectionNormals, TArray<FVector2f>(), TArray<FColor>(), TArray<FRuntimeMeshTangent>(), ERuntimeMeshUpdateFrequency::Infrequent, false);
-				if (!FoliageGenerated)
-					GenerateFoliage();
-			}
+				CollisionProvider->SetCollisionMesh(CollisionData);
+			});
 		}
 
-		if (mLandscapeGen->GetMaterial())
+		if (!GeneratingLOD)
+		{
+			LODLevel = LOD;
+
+			QueueDisplayUpload();
+		}
+	}
+}
+
+void ALandscapeSection::QueueDisplayUpload()
+{
+	//Game thread work is queued and applied by the generator within its per frame upload budget
+	bool bUseLODData = LODLevel > MeshDataLOD;
+	bool bFullDetail = !bUseLODData && LODLevel == 0 && mNodeLevel == 0;
+	int64 UploadBytes;
+	if (bUseLODData)
+	{
+		LODDataLastUsed = FPlatformTime::Seconds();
+		UploadBytes = GetMemoryUsage(ETerrainMemoryCategory::LODData);
+	}
+	else
+	{
+		MeshDataLastUsed = FPlatformTime::Seconds();
+		UploadBytes = GetMemoryUsage(ETerrainMemoryCategory::MeshData);
+	}
+
+	mLandscapeGen->EnqueueUpload(this, ETerrainUploadType::RenderMesh, UploadBytes, [this, bUseLODData, bFullDetail]()
+	{
+		mesh->SetCollisionEnabled(bFullDetail ? ECollisionEnabled::QueryAndPhysics : ECollisionEnabled::NoCollision);
+		if (bUseLODData)
+			StaticProvider->CreateSectionFromComponents(0, 0, 0, mSectionLODVertices, mSectionLODIndices, mSectionLODNormals, TArray<FVector2f>(), TArray<FColor>(), TArray<FRuntimeMeshTangent>(), ERuntimeMeshUpdateFrequency::Infrequent, false);
+		else
+			StaticProvider->CreateSectionFromComponents(0, 0, 0, mSectionVertices, mSectionIndices, mSectionNormals, TArray<FVector2f>(), TArray<FColor>(), TArray<FRuntimeMeshTangent>(), ERuntimeMeshUpdateFrequency::Infrequent, false);
+	});
+
+	mLandscapeGen->EnqueueUpload(this, ETerrainUploadType::Foliage, bFullDetail ? GetMemoryUsage(ETerrainMemoryCategory::FoliagePoints) : 0, [this, bFullDetail]()
+	{
+		if (bFullDetail && !FoliageGenerated)
+			GenerateFoliage();
+		else if (!bFullDetail && FoliageGenerated)
+			RemoveFoliage();
+	});
+
+	if (mLandscapeGen->GetMaterial())
+	{
+		mLandscapeGen->EnqueueUpload(this, ETerrainUploadType::Material, 0, [this]()
+		{
 			mesh->SetMaterial(0, mLandscapeGen->GetMaterial());
+		});
+	}
+}
+
+void ALandscapeSection::StartOperation(THREAD_OPERATION Operation)
+{
+	//All worker slots are busy, the generator starts the operation once one frees up
+	PendingOperation = Operation;
+	bOperationPending = true;
+	StartPendingOperation();
+}
 
+bool ALandscapeSection::StartPendingOperation()
+{
+	//Queued uploads read the section data, workers must not touch it until they have been applied.
+	//Only one operation runs at a time, the next one is started from OnOperationFinished
+	if (!bOperationPending || bOperationRunning || PendingUploads > 0 || !mLandscapeGen || !mLandscapeGen->TryReserveJob())
+		return false;
+
+	bOperationPending = false;
+	bOperationRunning = true;
+	Thread->StartOperation(PendingOperation);
+	return true;
+}
+
+void ALandscapeSection::OnOperationFinished()
+{
+	bOperationRunning = false;
+
+	if (bChecksumPending && mLandscapeGen)
+	{
+		bChecksumPending = false;
+		FTerrainSectionChecksum SectionChecksum;
+		SectionChecksum.Node = FIntVector(mTerrainCoords.X, mTerrainCoords.Y, mNodeLevel);
+		SectionChecksum.HeightChecksum = (int32) mHeightChecksum;
+		SectionChecksum.PointsChecksum = (int32) mPointsChecksum;
+		mLandscapeGen->RecordSectionChecksum(SectionChecksum);
+	}
+
+	//Deformation that arrived while the worker owned the data
+	if (bDeformationPending && bMeshGenerated)
+		ApplyDeformation(PendingDeformationRect);
+
+	//An operation requested while this one ran goes first, the generator dispatches it if no slot is free now
+	if (bOperationPending)
+	{
+		StartPendingOperation();
+		return;
 	}
+
+	//Continue towards the requested LOD straight away instead of waiting for the next generator tick
+	if (mLandscapeGen && TargetLOD >= 0 && LODLevel != TargetLOD)
+		UpdateTerrainSection(TargetLOD);
 }
 
 void ALandscapeSection::RemoveSection()
 {
+	//Wait for any running operation first, it still reads from the generator
+	if (Thread)
+	{
+		delete Thread;
+		Thread = nullptr;
+	}
+	bOperationPending = false;
+
 	if (StaticProvider)
 		StaticProvider->ClearSection(0, 0);
 
+	if (mLandscapeGen && mHeightfield.IsValid())
+		mLandscapeGen->RemoveHeightfield(FIntVector(mTerrainCoords.X, mTerrainCoords.Y, mNodeLevel), mHeightfield.Get());
+	mHeightfield.Reset();
+	mErosionTiles = FTerrainErosionTileSet();
+
 	mLandscapeGen = nullptr;
 	if (Points)
 	{
 		Points->ConditionalBeginDestroy();
 		Points = nullptr;
 	}
+}
 
-	if (Thread)
+FIntRect ALandscapeSection::CalcSectionLatticeRect(int Margin) const
+{
+	int Step = 1 << mNodeLevel;
+	FIntPoint Origin(mTerrainCoords.X * mComponentsPerAxis.X * Step, mTerrainCoords.Y * mComponentsPerAxis.Y * Step);
+	return FIntRect(Origin - FIntPoint(Margin, Margin), Origin + mComponentsPerAxis * Step + FIntPoint(Margin, Margin));
+}
+
+//Inclusive range of grid indices along one axis whose lattice position lies within [Min, Max]
+static bool CalcGridRangeInLattice(int Components, int LOD, int LatticeOrigin, int LatticeStep, int Min, int Max, int& OutMin, int& OutMax)
+{
+	OutMin = MAX_int32;
+	OutMax = -1;
+	int GridSize = CalcLODGridSize(Components, LOD);
+	for (int i = 0; i < GridSize; i++)
 	{
-		delete Thread;
-		Thread = nullptr;
+		int Lattice = LatticeOrigin + CalcLODSampleIndex(Components, LOD, i) * LatticeStep;
+		if (Lattice >= Min && Lattice <= Max)
+		{
+			OutMin = FMath::Min(OutMin, i);
+			OutMax = i;
+		}
 	}
+
+	return OutMax >= 0;
+}
+
+void ALandscapeSection::ApplyDeformation(const FIntRect& LatticeRect)
+{
+	//Worker threads own the section data while they run, data that isn't there yet is generated with the new deltas
+	if (bOperationRunning || !bMeshGenerated)
+	{
+		if (bDeformationPending)
+			PendingDeformationRect.Union(LatticeRect);
+		else
+			PendingDeformationRect = LatticeRect;
+		bDeformationPending = true;
+
+		//Evicted sections would otherwise keep showing the old surface until their LOD changes.
+		//The regenerated data reads the deltas when the worker starts and the section steps back up to its LOD from there
+		if (bMeshDataEvicted && !bOperationRunning && !bOperationPending)
+		{
+			bMeshDataEvicted = false;
+			bDeformationPending = false;
+			LODLevel = -1;
+			GenLOD = -1;
+			CollisionGenerated = false;
+			StartOperation(GEN_LANDSCAPE);
+		}
+		return;
+	}
+
+	FIntRect DirtyRect = LatticeRect;
+	bDeformationPending = false;
+
+	FIntPoint GridSize(CalcLODGridSize(mComponentsPerAxis.X, MeshDataLOD), CalcLODGridSize(mComponentsPerAxis.Y, MeshDataLOD));
+	int LatticeStep = 1 << mNodeLevel;
+	int GridStep = 1 << (mNodeLevel + MeshDataLOD);
+	FIntPoint Origin = CalcSectionLatticeRect(0).Min;
+
+	//Vertices on changed lattice points move, vertices one grid step further out get new normals
+	FIntRect NormalRect;
+	if (!CalcGridRangeInLattice(mComponentsPerAxis.X, MeshDataLOD, Origin.X, LatticeStep, DirtyRect.Min.X - GridStep, DirtyRect.Max.X + GridStep, NormalRect.Min.X, NormalRect.Max.X) ||
+		!CalcGridRangeInLattice(mComponentsPerAxis.Y, MeshDataLOD, Origin.Y, LatticeStep, DirtyRect.Min.Y - GridStep, DirtyRect.Max.Y + GridStep, NormalRect.Min.Y, NormalRect.Max.Y))
+		return;
+
+	if (mDeformation.IsValid())
+		mDeltaTiles = mDeformation->GatherTiles(CalcSectionLatticeRect(GridStep));
+
+	FIntRect VertexRect;
+	if (CalcGridRangeInLattice(mComponentsPerAxis.X, MeshDataLOD, Origin.X, LatticeStep, DirtyRect.Min.X, DirtyRect.Max.X, VertexRect.Min.X, VertexRect.Max.X) &&
+		CalcGridRangeInLattice(mComponentsPerAxis.Y, MeshDataLOD, Origin.Y, LatticeStep, DirtyRect.Min.Y, DirtyRect.Max.Y, VertexRect.Min.Y, VertexRect.Max.Y))
+	{
+		float rowVertDist = mSectionSize.Y / mComponentsPerAxis.Y;
+		float columnVertDist = mSectionSize.X / mComponentsPerAxis.X;
+		for (int j = VertexRect.Min.Y; j <= VertexRect.Max.Y; j++)
+		{
+			float yPos = rowVertDist * CalcLODSampleIndex(mComponentsPerAxis.Y, MeshDataLOD, j);
+			for (int i = VertexRect.Min.X; i <= VertexRect.Max.X; i++)
+			{
+				float xPos = columnVertDist * CalcLODSampleIndex(mComponentsPerAxis.X, MeshDataLOD, i);
+				mSectionVertices[CalcIndexFromGridPos(GridSize, i, j)] = CalculateVertexPosition(xPos, yPos);
+			}
+		}
+	}
+
+	auto IsDirty = [&GridSize, &NormalRect](int32 GridIndex)
+	{
+		int i = GridIndex % GridSize.X;
+		int j = GridIndex / GridSize.X;
+		return i >= NormalRect.Min.X && i <= NormalRect.Max.X && j >= NormalRect.Min.Y && j <= NormalRect.Max.Y;
+	};
+
+	if (!mCollisionOnly)
+	{
+		UpdateSectionNormals(GridSize, NormalRect);
+
+		int SkirtStart = GridSize.X * GridSize.Y;
+		for (int k = 0; k < mSkirtSourceIndices.Num() && SkirtStart + k < mSectionVertices.Num(); k++)
+		{
+			int32 SourceIndex = mSkirtSourceIndices[k];
+			if (!IsDirty(SourceIndex))
+				continue;
+
+			mSectionVertices[SkirtStart + k] = mSectionVertices[SourceIndex] - FVector3f(0.0f, 0.0f, mSkirtDepth);
+			mSectionNormals[SkirtStart + k] = mSectionNormals[SourceIndex];
+		}
+
+		//Only the LOD vertices copied from dirty mesh data vertices change
+		if (mLODSourceIndices.Num() == mSectionLODVertices.Num())
+		{
+			for (int k = 0; k < mLODSourceIndices.Num(); k++)
+			{
+				if (!IsDirty(mLODSourceIndices[k]))
+					continue;
+
+				mSectionLODVertices[k] = mSectionVertices[mLODSourceIndices[k]];
+				mSectionLODNormals[k] = mSectionNormals[mLODSourceIndices[k]];
+			}
+		}
+	}
+
+	BuildHeightfield(GridSize);
+	MeshDataLastUsed = FPlatformTime::Seconds();
+
+	//The triangulation is kept, only the moved collision vertices are refreshed
+	bool bCollisionActive = mCollisionOnly || (LODLevel == 0 && mNodeLevel == 0);
+	if (CollisionGenerated && mCollisionSourceIndices.Num() == CollisionData.Vertices.Num())
+	{
+		FRuntimeMeshCollisionData PatchedCollision;
+		PatchedCollision.Triangles = CollisionData.Triangles;
+		for (int32 SourceIndex : mCollisionSourceIndices)
+			PatchedCollision.Vertices.Add(mSectionVertices[SourceIndex]);
+		CollisionData = MoveTemp(PatchedCollision);
+		CollisionLastUsed = FPlatformTime::Seconds();
+	}
+	else if (bCollisionActive && LODLevel >= 0)
+	{
+		//Evicted collision is rebuilt from the patched mesh data and submitted once it completes
+		PendingDeformationRect = DirtyRect;
+		bDeformationPending = true;
+		if (!GeneratingCollision && !bOperationPending)
+		{
+			GeneratingCollision = true;
+			StartOperation(GEN_COLLISION);
+		}
+	}
+
+	//Nothing has been displayed yet, the first upload already includes the deformation
+	if (LODLevel < 0)
+		return;
+
+	if (bCollisionActive && CollisionGenerated)
+	{
+		mLandscapeGen->EnqueueUpload(this, ETerrainUploadType::Collision, GetMemoryUsage(ETerrainMemoryCategory::CollisionData), [this]()
+		{
+			CollisionProvider->SetCollisionMesh(CollisionData);
+		});
+	}
+
+	if (mCollisionOnly)
+		return;
+
+	//Evicted LOD data is subsampled again from the patched mesh data first
+	if (LODLevel > MeshDataLOD && GenLOD != LODLevel)
+	{
+		PendingDeformationRect = DirtyRect;
+		bDeformationPending = true;
+		if (!GeneratingLOD && !bOperationPending)
+		{
+			GenLOD = LODLevel;
+			GeneratingLOD = true;
+			StartOperation(GEN_LOD);
+		}
+		return;
+	}
+
+	QueueDisplayUpload();
+
+	//Foliage on the dirty area is moved onto the new surface, rects from deformations queued together are merged
+	if (FoliageGenerated)
+	{
+		FVector2D Padding = mSectionSize / FVector2D(mComponentsPerAxis) * GridStep;
+		PendingFoliageRect += FBox2D(mDeformation->LatticeToWorld(DirtyRect.Min) - Padding, mDeformation->LatticeToWorld(DirtyRect.Max) + Padding);
+		mLandscapeGen->EnqueueUpload(this, ETerrainUploadType::FoliageTransforms, 0, [this]()
+		{
+			if (FoliageGenerated && Points && mHeightfield.IsValid())
+			{
+				for (int InstanceIndex = 0; InstanceIndex < mFoliagePointIndices.Num(); InstanceIndex++)
+				{
+					FVector2D WorldPoint = Points->PointList[mFoliagePointIndices[InstanceIndex]] + FVector2D(mMeshOrigin);
+					if (PendingFoliageRect.IsInside(WorldPoint))
+						InstMesh->UpdateInstanceTransform(InstanceIndex, FTransform(FVector(WorldPoint, mHeightfield->SampleHeight(WorldPoint))), true, false);
+				}
+				InstMesh->MarkRenderStateDirty();
+			}
+			PendingFoliageRect.Init();
+		});
+	}
+}
+
+FBox ALandscapeSection::GetTerrainBounds() const
+{
+	return mHeightfield.IsValid() ? mHeightfield->GetBounds() : FBox(ForceInit);
+}
+
+int64 ALandscapeSection::GetMemoryUsage(ETerrainMemoryCategory Category) const
+{
+	switch (Category)
+	{
+	case ETerrainMemoryCategory::MeshData:
+		return mSectionVertices.GetAllocatedSize() + mSectionIndices.GetAllocatedSize() + mSectionNormals.GetAllocatedSize() + mSkirtSourceIndices.GetAllocatedSize();
+	case ETerrainMemoryCategory::LODData:
+		return mSectionLODVertices.GetAllocatedSize() + mSectionLODIndices.GetAllocatedSize() + mSectionLODNormals.GetAllocatedSize() + mLODSourceIndices.GetAllocatedSize();
+	case ETerrainMemoryCategory::CollisionData:
+		return int64(CollisionData.Vertices.Num()) * sizeof(FVector3f) + int64(CollisionData.Triangles.Num()) * 3 * sizeof(int32) + mCollisionVertices.GetAllocatedSize() + mCollisionSourceIndices.GetAllocatedSize();
+	case ETerrainMemoryCategory::FoliagePoints:
+		return Points ? Points->PointList.GetAllocatedSize() : 0;
+	case ETerrainMemoryCategory::Heightfield:
+		return mHeightfield.IsValid() ? mHeightfield->GetAllocatedSize() : 0;
+	}
+
+	return 0;
+}
+
+double ALandscapeSection::GetLastUsedTime(ETerrainMemoryCategory Category) const
+{
+	switch (Category)
+	{
+	case ETerrainMemoryCategory::MeshData:
+		return MeshDataLastUsed;
+	case ETerrainMemoryCategory::LODData:
+		return LODDataLastUsed;
+	case ETerrainMemoryCategory::CollisionData:
+		return CollisionLastUsed;
+	default:
+		return 0.0;
+	}
+}
+
+void ALandscapeSection::TouchDisplayedData(double Now)
+{
+	if (LODLevel < 0)
+		return;
+
+	//Sections showing a coarser LOD only need their full resolution data to subsample it again
+	if (LODLevel > MeshDataLOD)
+		LODDataLastUsed = Now;
+	else
+		MeshDataLastUsed = Now;
+
+	if (mCollisionOnly || (LODLevel == 0 && mNodeLevel == 0))
+		CollisionLastUsed = Now;
+}
+
+int64 ALandscapeSection::EvictData(ETerrainMemoryCategory Category)
+{
+	//Worker threads may be reading or writing any of the data, and nothing can be dropped before it has been shown once
+	if (bOperationRunning || bOperationPending || GeneratingLOD || GeneratingCollision || LODLevel < 0 || PendingUploads > 0)
+		return 0;
+
+	int64 Freed = GetMemoryUsage(Category);
+	switch (Category)
+	{
+	case ETerrainMemoryCategory::MeshData:
+		//Whatever is displayed was uploaded already, height queries and foliage use the heightfield
+		if (!bMeshGenerated)
+			return 0;
+		mSectionVertices.Empty();
+		mSectionIndices.Empty();
+		mSectionNormals.Empty();
+		mSkirtSourceIndices.Empty();
+		bMeshGenerated = false;
+		bMeshDataEvicted = true;
+		break;
+	case ETerrainMemoryCategory::LODData:
+		mSectionLODVertices.Empty();
+		mSectionLODIndices.Empty();
+		mSectionLODNormals.Empty();
+		mLODSourceIndices.Empty();
+		GenLOD = -1;
+		break;
+	case ETerrainMemoryCategory::CollisionData:
+		//The collision provider keeps what was submitted, this is only the copy used to submit it again
+		CollisionData = FRuntimeMeshCollisionData();
+		mCollisionVertices.Empty();
+		mCollisionSourceIndices.Empty();
+		CollisionGenerated = false;
+		break;
+	default:
+		return 0;
+	}
+
+	return Freed;
 }
 
 /*******************************************
 MultiThreader
 *******************************************/
 
-FGeneratorThread::FGeneratorThread(ALandscapeSection* Section)
+FGeneratorThread::FGeneratorThread(ALandscapeSection* Section, FThreadSafeCounter* JobCounter)
 {
-	Thread = nullptr;
-	bRunThread = true;
 	mSection = Section;
+	mJobCounter = JobCounter;
 	mOperation = GEN_LANDSCAPE;
+	DoneEvent = FPlatformProcess::GetSynchEventFromPool(true);
+	DoneEvent->Trigger();
+	bQueued = false;
 }
 
 bool FGeneratorThread::StartOperation(THREAD_OPERATION operation)
 {
+	check(IsInGameThread());
 	mOperation = operation;
-
-	Thread = FRunnableThread::Create(this, TEXT("GeneratorThread"));
+	DoneEvent->Reset();
+	bQueued = true;
+	GThreadPool->AddQueuedWork(this);
 	return true;
 }
 
 FGeneratorThread::~FGeneratorThread()
 {
-	if (Thread)
+	//Work still waiting in the pool is taken back, its reserved job slot has to be released here
+	if (bQueued && GThreadPool && GThreadPool->RetractQueuedWork(this))
 	{
-		Thread->Kill();
-		delete Thread;
+		if (mJobCounter)
+			mJobCounter->Decrement();
 	}
-}
+	else
+		DoneEvent->Wait();
 
-bool FGeneratorThread::Init()
-{
-	return true;
+	FPlatformProcess::ReturnSynchEventToPool(DoneEvent);
+	DoneEvent = nullptr;
 }
 
-uint32 FGeneratorThread::Run()
+void FGeneratorThread::DoThreadedWork()
 {
 	switch (mOperation)
 	{
@@ -494,14 +1159,28 @@ uint32 FGeneratorThread::Run()
 		mSection->GenerateLODData(mSection->GenLOD);
 		break;
 	case GEN_COLLISION:
-		mSection->GenerateCollisionFromLOD(1);
+		mSection->GenerateCollisionFromLOD(FMath::Max(1, mSection->MeshDataLOD));
 		break;
 	}
 
-	return 1;
+	if (mJobCounter)
+		mJobCounter->Decrement();
+
+	TWeakObjectPtr<ALandscapeSection> WeakSection(mSection);
+	AsyncTask(ENamedThreads::GameThread, [WeakSection]()
+	{
+		if (WeakSection.IsValid())
+			WeakSection->OnOperationFinished();
+	});
+
+	DoneEvent->Trigger();
 }
 
-void FGeneratorThread::Stop()
+void FGeneratorThread::Abandon()
 {
-	bRunThread = false;
-}
\ No newline at end of file
+	//Only happens while the pool shuts down, the section never hears back
+	if (mJobCounter)
+		mJobCounter->Decrement();
+
+	DoneEvent->Trigger();
+}
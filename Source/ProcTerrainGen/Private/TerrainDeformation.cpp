@@ -0,0 +1,119 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainDeformation.h"
+
+float FTerrainDeltaTileSet::GetDelta(const FIntPoint& Lattice) const
+{
+	FIntPoint TileCoord(FMath::DivideAndRoundDown(Lattice.X, TileSize.X), FMath::DivideAndRoundDown(Lattice.Y, TileSize.Y));
+	const FTerrainDeltaTilePtr* Tile = Tiles.Find(TileCoord);
+	if (!Tile)
+		return 0.0f;
+
+	const float* Delta = (*Tile)->Deltas.Find(Lattice);
+	return Delta ? *Delta : 0.0f;
+}
+
+FTerrainDeformation::FTerrainDeformation(const FVector2D& InVertexSpacing, const FIntPoint& InTileSize)
+	: VertexSpacing(InVertexSpacing)
+	, TileSize(InTileSize)
+{
+}
+
+FIntPoint FTerrainDeformation::WorldToLattice(const FVector2D& Location) const
+{
+	return FIntPoint(FMath::RoundToInt(Location.X / VertexSpacing.X), FMath::RoundToInt(Location.Y / VertexSpacing.Y));
+}
+
+FVector2D FTerrainDeformation::LatticeToWorld(const FIntPoint& Lattice) const
+{
+	return FVector2D(Lattice.X * VertexSpacing.X, Lattice.Y * VertexSpacing.Y);
+}
+
+FIntPoint FTerrainDeformation::CalcTileCoord(const FIntPoint& Lattice) const
+{
+	return FIntPoint(FMath::DivideAndRoundDown(Lattice.X, TileSize.X), FMath::DivideAndRoundDown(Lattice.Y, TileSize.Y));
+}
+
+FTerrainDeltaTileSet FTerrainDeformation::GatherTiles(const FIntRect& LatticeRect) const
+{
+	FTerrainDeltaTileSet TileSet;
+	TileSet.TileSize = TileSize;
+
+	FIntPoint MinTile = CalcTileCoord(LatticeRect.Min);
+	FIntPoint MaxTile = CalcTileCoord(LatticeRect.Max);
+
+	FRWScopeLock Lock(TileLock, SLT_ReadOnly);
+	if (Tiles.Num() == 0)
+		return TileSet;
+
+	for (int Y = MinTile.Y; Y <= MaxTile.Y; Y++)
+	{
+		for (int X = MinTile.X; X <= MaxTile.X; X++)
+		{
+			const FTerrainDeltaTilePtr* Tile = Tiles.Find(FIntPoint(X, Y));
+			if (Tile)
+				TileSet.Tiles.Add(FIntPoint(X, Y), *Tile);
+		}
+	}
+
+	return TileSet;
+}
+
+float FTerrainDeformation::SampleDelta(const FVector2D& Location) const
+{
+	float LatticeX = Location.X / VertexSpacing.X;
+	float LatticeY = Location.Y / VertexSpacing.Y;
+	FIntPoint Min(FMath::FloorToInt(LatticeX), FMath::FloorToInt(LatticeY));
+	float AlphaX = LatticeX - Min.X;
+	float AlphaY = LatticeY - Min.Y;
+
+	FTerrainDeltaTileSet TileSet = GatherTiles(FIntRect(Min, Min + FIntPoint(1, 1)));
+	if (TileSet.Tiles.Num() == 0)
+		return 0.0f;
+
+	float Delta0 = FMath::Lerp(TileSet.GetDelta(Min), TileSet.GetDelta(Min + FIntPoint(1, 0)), AlphaX);
+	float Delta1 = FMath::Lerp(TileSet.GetDelta(Min + FIntPoint(0, 1)), TileSet.GetDelta(Min + FIntPoint(1, 1)), AlphaX);
+	return FMath::Lerp(Delta0, Delta1, AlphaY);
+}
+
+void FTerrainDeformation::ModifyDeltas(const FIntRect& LatticeRect, TFunctionRef<float(const FIntPoint& Lattice, float Delta)> Modify)
+{
+	FIntPoint MinTile = CalcTileCoord(LatticeRect.Min);
+	FIntPoint MaxTile = CalcTileCoord(LatticeRect.Max);
+
+	for (int TileY = MinTile.Y; TileY <= MaxTile.Y; TileY++)
+	{
+		for (int TileX = MinTile.X; TileX <= MaxTile.X; TileX++)
+		{
+			FIntPoint TileCoord(TileX, TileY);
+
+			//Only the game thread writes, so the current tile can be read without holding the lock while the copy is edited
+			TSharedPtr<FTerrainDeltaTile, ESPMode::ThreadSafe> NewTile = MakeShared<FTerrainDeltaTile, ESPMode::ThreadSafe>();
+			const FTerrainDeltaTilePtr* OldTile = Tiles.Find(TileCoord);
+			if (OldTile)
+				NewTile->Deltas = (*OldTile)->Deltas;
+
+			FIntPoint Min(FMath::Max(LatticeRect.Min.X, TileX * TileSize.X), FMath::Max(LatticeRect.Min.Y, TileY * TileSize.Y));
+			FIntPoint Max(FMath::Min(LatticeRect.Max.X, (TileX + 1) * TileSize.X - 1), FMath::Min(LatticeRect.Max.Y, (TileY + 1) * TileSize.Y - 1));
+			for (int Y = Min.Y; Y <= Max.Y; Y++)
+			{
+				for (int X = Min.X; X <= Max.X; X++)
+				{
+					FIntPoint Lattice(X, Y);
+					float Delta = Modify(Lattice, NewTile->Deltas.FindRef(Lattice));
+					if (FMath::IsNearlyZero(Delta))
+						NewTile->Deltas.Remove(Lattice);
+					else
+						NewTile->Deltas.Add(Lattice, Delta);
+				}
+			}
+
+			FRWScopeLock Lock(TileLock, SLT_Write);
+			if (NewTile->Deltas.Num() > 0)
+				Tiles.Add(TileCoord, NewTile);
+			else
+				Tiles.Remove(TileCoord);
+		}
+	}
+}
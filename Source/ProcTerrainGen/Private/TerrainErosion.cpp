@@ -0,0 +1,340 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainErosion.h"
+#include "TerrainNoise.h"
+#include "Async/ParallelFor.h"
+
+namespace TerrainErosion
+{
+	float BilinearSample(const TArray<float>& Values, int Resolution, float GridX, float GridY)
+	{
+		GridX = FMath::Clamp(GridX, 0.0f, float(Resolution - 1));
+		GridY = FMath::Clamp(GridY, 0.0f, float(Resolution - 1));
+		int X0 = FMath::Min(FMath::FloorToInt(GridX), Resolution - 2);
+		int Y0 = FMath::Min(FMath::FloorToInt(GridY), Resolution - 2);
+		float AlphaX = GridX - X0;
+		float AlphaY = GridY - Y0;
+
+		int Index = Y0 * Resolution + X0;
+		float Height0 = FMath::Lerp(Values[Index], Values[Index + 1], AlphaX);
+		float Height1 = FMath::Lerp(Values[Index + Resolution], Values[Index + Resolution + 1], AlphaX);
+		return FMath::Lerp(Height0, Height1, AlphaY);
+	}
+
+	float HeightAndGradient(const TArray<float>& Heights, int Resolution, float PosX, float PosY, float& OutGradientX, float& OutGradientY)
+	{
+		int CellX = FMath::FloorToInt(PosX);
+		int CellY = FMath::FloorToInt(PosY);
+		float AlphaX = PosX - CellX;
+		float AlphaY = PosY - CellY;
+
+		int Index = CellY * Resolution + CellX;
+		float HeightNW = Heights[Index];
+		float HeightNE = Heights[Index + 1];
+		float HeightSW = Heights[Index + Resolution];
+		float HeightSE = Heights[Index + Resolution + 1];
+
+		OutGradientX = (HeightNE - HeightNW) * (1.0f - AlphaY) + (HeightSE - HeightSW) * AlphaY;
+		OutGradientY = (HeightSW - HeightNW) * (1.0f - AlphaX) + (HeightSE - HeightNE) * AlphaX;
+
+		return HeightNW * (1.0f - AlphaX) * (1.0f - AlphaY) + HeightNE * AlphaX * (1.0f - AlphaY) + HeightSW * (1.0f - AlphaX) * AlphaY + HeightSE * AlphaX * AlphaY;
+	}
+
+	//Spreads Amount over the four samples of a cell with bilinear weights
+	void AddToCell(TArray<float>& Heights, int Resolution, int CellX, int CellY, float AlphaX, float AlphaY, float Amount)
+	{
+		int Index = CellY * Resolution + CellX;
+		Heights[Index] += Amount * (1.0f - AlphaX) * (1.0f - AlphaY);
+		Heights[Index + 1] += Amount * AlphaX * (1.0f - AlphaY);
+		Heights[Index + Resolution] += Amount * (1.0f - AlphaX) * AlphaY;
+		Heights[Index + Resolution + 1] += Amount * AlphaX * AlphaY;
+	}
+}
+
+float FTerrainErosionTile::SampleDelta(const FVector2D& Location) const
+{
+	return TerrainErosion::BilinearSample(Delta, Resolution, (Location.X - Origin.X) / Spacing.X, (Location.Y - Origin.Y) / Spacing.Y);
+}
+
+const FTerrainErosionTile* FTerrainErosionTileSet::FindTile(const FIntPoint& TileCoord) const
+{
+	FIntPoint Local = TileCoord - MinTile;
+	if (Local.X < 0 || Local.Y < 0 || Local.X >= NumTiles.X || Local.Y >= NumTiles.Y)
+		return nullptr;
+
+	return Tiles[Local.Y * NumTiles.X + Local.X].Get();
+}
+
+FTerrainErosionCache::FTerrainErosionCache(const FTerrainErosionSettings& InSettings, const FVector2D& InSectionSize, uint32 InSeed)
+	: Settings(InSettings)
+	, SectionSize(InSectionSize)
+	, Seed(InSeed)
+{
+	Settings.TileResolution = FMath::Clamp(Settings.TileResolution, 9, 257);
+}
+
+FTerrainErosionTileSet FTerrainErosionCache::GatherTiles(const FVector2D& Min, const FVector2D& Max, const FTerrainNoiseParameters& NoiseParams)
+{
+	FTerrainErosionTileSet TileSet;
+	TileSet.MinTile = FIntPoint(FMath::FloorToInt(Min.X / SectionSize.X), FMath::FloorToInt(Min.Y / SectionSize.Y));
+	FIntPoint MaxTile(FMath::CeilToInt(Max.X / SectionSize.X), FMath::CeilToInt(Max.Y / SectionSize.Y));
+	TileSet.NumTiles = MaxTile - TileSet.MinTile + FIntPoint(1, 1);
+	TileSet.Tiles.SetNum(TileSet.NumTiles.X * TileSet.NumTiles.Y);
+
+	ParallelFor(TileSet.Tiles.Num(), [&](int32 Index)
+	{
+		FIntPoint TileCoord = TileSet.MinTile + FIntPoint(Index % TileSet.NumTiles.X, Index / TileSet.NumTiles.X);
+		TileSet.Tiles[Index] = FindOrBuildTile(TileCoord, NoiseParams);
+	});
+
+	return TileSet;
+}
+
+float FTerrainErosionCache::SampleDelta(const FVector2D& Location, const FTerrainNoiseParameters& NoiseParams, const FTerrainErosionTileSet* TileSet)
+{
+	float TileX = Location.X / SectionSize.X;
+	float TileY = Location.Y / SectionSize.Y;
+	FIntPoint MinTile(FMath::FloorToInt(TileX), FMath::FloorToInt(TileY));
+	float AlphaX = TileX - MinTile.X;
+	float AlphaY = TileY - MinTile.Y;
+
+	//Tent weights of the four tiles covering the location
+	float Delta = 0.0f;
+	for (int j = 0; j < 2; j++)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			float Weight = (i ? AlphaX : 1.0f - AlphaX) * (j ? AlphaY : 1.0f - AlphaY);
+			if (Weight <= 0.0f)
+				continue;
+
+			FIntPoint TileCoord = MinTile + FIntPoint(i, j);
+
+			const FTerrainErosionTile* Tile = TileSet ? TileSet->FindTile(TileCoord) : nullptr;
+			if (Tile)
+			{
+				Delta += Tile->SampleDelta(Location) * Weight;
+			}
+			else
+			{
+				FTerrainErosionTilePtr CachedTile = FindOrBuildTile(TileCoord, NoiseParams);
+				Delta += CachedTile->SampleDelta(Location) * Weight;
+			}
+		}
+	}
+
+	return Delta;
+}
+
+bool FTerrainErosionCache::SampleCachedDelta(const FVector2D& Location, float& OutDelta) const
+{
+	float TileX = Location.X / SectionSize.X;
+	float TileY = Location.Y / SectionSize.Y;
+	FIntPoint MinTile(FMath::FloorToInt(TileX), FMath::FloorToInt(TileY));
+	float AlphaX = TileX - MinTile.X;
+	float AlphaY = TileY - MinTile.Y;
+
+	FRWScopeLock Lock(TileLock, SLT_ReadOnly);
+	OutDelta = 0.0f;
+	for (int j = 0; j < 2; j++)
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			float Weight = (i ? AlphaX : 1.0f - AlphaX) * (j ? AlphaY : 1.0f - AlphaY);
+			if (Weight <= 0.0f)
+				continue;
+
+			const FTerrainErosionTilePtr* Tile = Tiles.Find(MinTile + FIntPoint(i, j));
+			if (!Tile)
+				return false;
+
+			OutDelta += (*Tile)->SampleDelta(Location) * Weight;
+		}
+	}
+
+	return true;
+}
+
+int32 FTerrainErosionCache::EvictUnreferencedTiles()
+{
+	//The cache's own reference is the only one left once every section using a tile is gone
+	FRWScopeLock Lock(TileLock, SLT_Write);
+	int32 Evicted = 0;
+	for (auto It = Tiles.CreateIterator(); It; ++It)
+	{
+		if (It->Value.GetSharedReferenceCount() <= 1)
+		{
+			It.RemoveCurrent();
+			Evicted++;
+		}
+	}
+
+	return Evicted;
+}
+
+int64 FTerrainErosionCache::GetMemoryUsage() const
+{
+	FRWScopeLock Lock(TileLock, SLT_ReadOnly);
+	int64 Bytes = Tiles.GetAllocatedSize();
+	for (const TPair<FIntPoint, FTerrainErosionTilePtr>& Tile : Tiles)
+		Bytes += sizeof(FTerrainErosionTile) + Tile.Value->Delta.GetAllocatedSize();
+
+	return Bytes;
+}
+
+FTerrainErosionTilePtr FTerrainErosionCache::FindOrBuildTile(const FIntPoint& TileCoord, const FTerrainNoiseParameters& NoiseParams)
+{
+	{
+		FRWScopeLock Lock(TileLock, SLT_ReadOnly);
+		FTerrainErosionTilePtr* Found = Tiles.Find(TileCoord);
+		if (Found)
+			return *Found;
+	}
+
+	FTerrainErosionTilePtr NewTile = BuildTile(TileCoord, NoiseParams);
+
+	//Another thread may have finished the same tile first, both are identical so keep the one already cached
+	FRWScopeLock Lock(TileLock, SLT_Write);
+	FTerrainErosionTilePtr* Found = Tiles.Find(TileCoord);
+	if (Found)
+		return *Found;
+
+	Tiles.Add(TileCoord, NewTile);
+	return NewTile;
+}
+
+FTerrainErosionTilePtr FTerrainErosionCache::BuildTile(const FIntPoint& TileCoord, const FTerrainNoiseParameters& NoiseParams) const
+{
+	int Resolution = Settings.TileResolution;
+
+	TSharedPtr<FTerrainErosionTile, ESPMode::ThreadSafe> Tile = MakeShared<FTerrainErosionTile, ESPMode::ThreadSafe>();
+	Tile->TileCoord = TileCoord;
+	Tile->Origin = FVector2D(TileCoord.X - 1, TileCoord.Y - 1) * SectionSize;
+	Tile->Spacing = SectionSize * 2.0 / (Resolution - 1);
+	Tile->Resolution = Resolution;
+
+	//Erosion works in units of the sample spacing so the settings don't depend on the world scale
+	float GridUnit = (Tile->Spacing.X + Tile->Spacing.Y) * 0.5f;
+
+	TArray<float> BaseHeights;
+	BaseHeights.SetNumUninitialized(Resolution * Resolution);
+	for (int j = 0; j < Resolution; j++)
+	{
+		for (int i = 0; i < Resolution; i++)
+		{
+			FVector2D Location = Tile->Origin + FVector2D(i, j) * Tile->Spacing;
+			BaseHeights[j * Resolution + i] = NoiseParams.CalculateBaseHeight(Location.X, Location.Y) / GridUnit;
+		}
+	}
+
+	TArray<float> Heights = BaseHeights;
+	FRandomStream Random(int32(HashCombine(Seed, GetTypeHash(TileCoord))));
+	ErodeHydraulic(Heights, Resolution, Random);
+	ErodeThermal(Heights, Resolution);
+
+	Tile->Delta.SetNumUninitialized(Heights.Num());
+	for (int i = 0; i < Heights.Num(); i++)
+		Tile->Delta[i] = (Heights[i] - BaseHeights[i]) * GridUnit;
+
+	return Tile;
+}
+
+void FTerrainErosionCache::ErodeHydraulic(TArray<float>& Heights, int Resolution, FRandomStream& Random) const
+{
+	for (int Droplet = 0; Droplet < Settings.DropletsPerTile; Droplet++)
+	{
+		float PosX = Random.FRandRange(0.0f, Resolution - 1.001f);
+		float PosY = Random.FRandRange(0.0f, Resolution - 1.001f);
+		float DirX = 0.0f;
+		float DirY = 0.0f;
+		float Speed = 1.0f;
+		float Water = 1.0f;
+		float Sediment = 0.0f;
+
+		for (int Lifetime = 0; Lifetime < Settings.MaxDropletLifetime; Lifetime++)
+		{
+			int CellX = FMath::FloorToInt(PosX);
+			int CellY = FMath::FloorToInt(PosY);
+			float AlphaX = PosX - CellX;
+			float AlphaY = PosY - CellY;
+
+			float GradientX, GradientY;
+			float Height = TerrainErosion::HeightAndGradient(Heights, Resolution, PosX, PosY, GradientX, GradientY);
+
+			DirX = DirX * Settings.Inertia - GradientX * (1.0f - Settings.Inertia);
+			DirY = DirY * Settings.Inertia - GradientY * (1.0f - Settings.Inertia);
+			float DirLength = FMath::Sqrt(DirX * DirX + DirY * DirY);
+			if (DirLength < KINDA_SMALL_NUMBER)
+				break;
+
+			DirX /= DirLength;
+			DirY /= DirLength;
+			PosX += DirX;
+			PosY += DirY;
+
+			//Droplets leaving the tile take their sediment with them, the tent weight hides the tile border anyway
+			if (PosX < 0.0f || PosY < 0.0f || PosX >= Resolution - 1 || PosY >= Resolution - 1)
+				break;
+
+			float NewGradientX, NewGradientY;
+			float DeltaHeight = TerrainErosion::HeightAndGradient(Heights, Resolution, PosX, PosY, NewGradientX, NewGradientY) - Height;
+
+			float Capacity = FMath::Max(-DeltaHeight * Speed * Water * Settings.SedimentCapacity, Settings.MinSedimentCapacity);
+			if (Sediment > Capacity || DeltaHeight > 0.0f)
+			{
+				//Fill the pit when going uphill, otherwise drop what can't be carried
+				float Deposit = DeltaHeight > 0.0f ? FMath::Min(DeltaHeight, Sediment) : (Sediment - Capacity) * Settings.DepositSpeed;
+				Sediment -= Deposit;
+				TerrainErosion::AddToCell(Heights, Resolution, CellX, CellY, AlphaX, AlphaY, Deposit);
+			}
+			else
+			{
+				float Erode = FMath::Min((Capacity - Sediment) * Settings.ErodeSpeed, -DeltaHeight);
+				Sediment += Erode;
+				TerrainErosion::AddToCell(Heights, Resolution, CellX, CellY, AlphaX, AlphaY, -Erode);
+			}
+
+			Speed = FMath::Sqrt(FMath::Max(0.0f, Speed * Speed - DeltaHeight * Settings.Gravity));
+			Water *= 1.0f - Settings.EvaporateSpeed;
+		}
+	}
+}
+
+void FTerrainErosionCache::ErodeThermal(TArray<float>& Heights, int Resolution) const
+{
+	static const FIntPoint Neighbours[] = { FIntPoint(1, 0), FIntPoint(-1, 0), FIntPoint(0, 1), FIntPoint(0, -1) };
+
+	//Changes are gathered before being applied so the result doesn't depend on the visiting order
+	TArray<float> Changes;
+	for (int Iteration = 0; Iteration < Settings.ThermalIterations; Iteration++)
+	{
+		Changes.Init(0.0f, Heights.Num());
+		for (int j = 0; j < Resolution; j++)
+		{
+			for (int i = 0; i < Resolution; i++)
+			{
+				int Index = j * Resolution + i;
+				for (const FIntPoint& Offset : Neighbours)
+				{
+					int NeighbourX = i + Offset.X;
+					int NeighbourY = j + Offset.Y;
+					if (NeighbourX < 0 || NeighbourY < 0 || NeighbourX >= Resolution || NeighbourY >= Resolution)
+						continue;
+
+					int NeighbourIndex = NeighbourY * Resolution + NeighbourX;
+					float Difference = Heights[Index] - Heights[NeighbourIndex];
+					if (Difference <= Settings.TalusSlope)
+						continue;
+
+					float Moved = (Difference - Settings.TalusSlope) * Settings.ThermalRate * 0.25f;
+					Changes[Index] -= Moved;
+					Changes[NeighbourIndex] += Moved;
+				}
+			}
+		}
+
+		for (int i = 0; i < Heights.Num(); i++)
+			Heights[i] += Changes[i];
+	}
+}
@@ -0,0 +1,264 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainExportCommandlet.h"
+#include "LandscapeGenerator.h"
+#include "LandscapeSection.h"
+#include "DiskSampler.h"
+#include "TerrainErosion.h"
+#include "IImageWrapper.h"
+#include "IImageWrapperModule.h"
+#include "Modules/ModuleManager.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "HAL/FileManager.h"
+#include "Async/ParallelFor.h"
+#include "SimplexNoise/Public/SimplexNoiseBPLibrary.h"
+
+DEFINE_LOG_CATEGORY_STATIC(LogTerrainExport, Log, All);
+
+namespace
+{
+	//Samples per axis of the coarse grid used to guess the height range of a RAW export
+	const int HeightRangeSamples = 256;
+
+	//Range of the base height over a coarse grid, padded since erosion and the coarse spacing can both exceed it
+	void EstimateHeightRange(const FTerrainNoiseParameters& NoiseParams, const FVector2D& Min, const FVector2D& Max, float& OutMin, float& OutMax)
+	{
+		TArray<FVector2f> RowRanges;
+		RowRanges.SetNumUninitialized(HeightRangeSamples);
+		FVector2D Step = (Max - Min) / (HeightRangeSamples - 1);
+
+		ParallelFor(HeightRangeSamples, [&](int32 j)
+		{
+			FVector2f Range(MAX_flt, -MAX_flt);
+			for (int i = 0; i < HeightRangeSamples; i++)
+			{
+				FVector2D Location = Min + FVector2D(i, j) * Step;
+				float Height = NoiseParams.CalculateBaseHeight(Location.X, Location.Y);
+				Range.X = FMath::Min(Range.X, Height);
+				Range.Y = FMath::Max(Range.Y, Height);
+			}
+			RowRanges[j] = Range;
+		});
+
+		OutMin = MAX_flt;
+		OutMax = -MAX_flt;
+		for (const FVector2f& Range : RowRanges)
+		{
+			OutMin = FMath::Min(OutMin, Range.X);
+			OutMax = FMath::Max(OutMax, Range.Y);
+		}
+
+		float Padding = FMath::Max((OutMax - OutMin) * 0.1f, 1.0f);
+		OutMin -= Padding;
+		OutMax += Padding;
+	}
+
+	bool WriteHeightTile(const FString& Path, const TArray<float>& Heights, const FIntPoint& Resolution, bool bExr, float HeightMin, float HeightMax)
+	{
+		if (bExr)
+		{
+			IImageWrapperModule& ImageWrapperModule = FModuleManager::LoadModuleChecked<IImageWrapperModule>(FName("ImageWrapper"));
+			TSharedPtr<IImageWrapper> ImageWrapper = ImageWrapperModule.CreateImageWrapper(EImageFormat::EXR);
+			if (!ImageWrapper.IsValid() || !ImageWrapper->SetRaw(Heights.GetData(), Heights.Num() * sizeof(float), Resolution.X, Resolution.Y, ERGBFormat::GrayF, 32))
+				return false;
+
+			const TArray64<uint8> Compressed = ImageWrapper->GetCompressed();
+			return FFileHelper::SaveArrayToFile(Compressed, *Path);
+		}
+
+		//Little endian 16 bit, the layout landscape importers expect
+		TArray<uint8> RawData;
+		RawData.SetNumUninitialized(Heights.Num() * 2);
+		float InvRange = 1.0f / FMath::Max(HeightMax - HeightMin, KINDA_SMALL_NUMBER);
+		for (int k = 0; k < Heights.Num(); k++)
+		{
+			uint16 Value = (uint16) FMath::Clamp(FMath::RoundToInt((Heights[k] - HeightMin) * InvRange * 65535.0f), 0, 65535);
+			RawData[k * 2] = Value & 0xFF;
+			RawData[k * 2 + 1] = Value >> 8;
+		}
+
+		return FFileHelper::SaveArrayToFile(RawData, *Path);
+	}
+
+	//Bilinear height of the tile grid, matching how sections sample their heightfield when placing foliage
+	float SampleTileHeight(const TArray<float>& Heights, const FIntPoint& Resolution, const FVector2D& GridPos)
+	{
+		int X0 = FMath::Clamp(FMath::FloorToInt(GridPos.X), 0, Resolution.X - 2);
+		int Y0 = FMath::Clamp(FMath::FloorToInt(GridPos.Y), 0, Resolution.Y - 2);
+		float FracX = FMath::Clamp((float) GridPos.X - X0, 0.0f, 1.0f);
+		float FracY = FMath::Clamp((float) GridPos.Y - Y0, 0.0f, 1.0f);
+
+		float H00 = Heights[X0 + Y0 * Resolution.X];
+		float H10 = Heights[X0 + 1 + Y0 * Resolution.X];
+		float H01 = Heights[X0 + (Y0 + 1) * Resolution.X];
+		float H11 = Heights[X0 + 1 + (Y0 + 1) * Resolution.X];
+
+		return FMath::Lerp(FMath::Lerp(H00, H10, FracX), FMath::Lerp(H01, H11, FracX), FracY);
+	}
+}
+
+UTerrainExportCommandlet::UTerrainExportCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = false;
+	LogToConsole = true;
+}
+
+int32 UTerrainExportCommandlet::Main(const FString& Params)
+{
+	const TCHAR* CmdLine = *Params;
+
+	//Settings come from the class default object, a blueprint subclass carries the designer's values
+	UClass* GeneratorClass = ALandscapeGenerator::StaticClass();
+	FString GeneratorPath;
+	if (FParse::Value(CmdLine, TEXT("Generator="), GeneratorPath))
+	{
+		GeneratorClass = LoadClass<ALandscapeGenerator>(nullptr, *GeneratorPath);
+		if (!GeneratorClass)
+		{
+			UE_LOG(LogTerrainExport, Error, TEXT("Could not load generator class %s"), *GeneratorPath);
+			return 1;
+		}
+	}
+	const ALandscapeGenerator* Generator = GeneratorClass->GetDefaultObject<ALandscapeGenerator>();
+
+	FIntPoint RegionMin(0, 0);
+	FIntPoint RegionMax(0, 0);
+	FParse::Value(CmdLine, TEXT("MinX="), RegionMin.X);
+	FParse::Value(CmdLine, TEXT("MinY="), RegionMin.Y);
+	FParse::Value(CmdLine, TEXT("MaxX="), RegionMax.X);
+	FParse::Value(CmdLine, TEXT("MaxY="), RegionMax.Y);
+	if (RegionMax.X < RegionMin.X || RegionMax.Y < RegionMin.Y)
+	{
+		UE_LOG(LogTerrainExport, Error, TEXT("Region max must not be below region min"));
+		return 1;
+	}
+
+	int32 Seed = 0;
+	FParse::Value(CmdLine, TEXT("Seed="), Seed);
+	int32 TileSections = 8;
+	FParse::Value(CmdLine, TEXT("TileSections="), TileSections);
+	TileSections = FMath::Max(TileSections, 1);
+	FString Format = TEXT("RAW");
+	FParse::Value(CmdLine, TEXT("Format="), Format);
+	bool bExr = Format.Equals(TEXT("EXR"), ESearchCase::IgnoreCase);
+	bool bExportPoints = !FParse::Param(CmdLine, TEXT("NoPoints"));
+	FString OutDir = FPaths::ProjectSavedDir() / TEXT("TerrainExport");
+	FParse::Value(CmdLine, TEXT("Out="), OutDir);
+	IFileManager::Get().MakeDirectory(*OutDir, true);
+
+	FVector2D SectionSize = Generator->LandscapeSectionSize;
+	FIntPoint Components = Generator->LandscapeComponentSize;
+	FVector2D VertexSpacing = SectionSize / FVector2D(Components);
+	//Same global permutation table the generator seeds, otherwise the export wouldn't match the game for this seed
+	USimplexNoiseBPLibrary::setNoiseSeed(Seed);
+	FTerrainNoiseParameters NoiseParams = Generator->MakeStandaloneNoiseParameters(Seed);
+
+	FIntPoint RegionSections = RegionMax - RegionMin + FIntPoint(1, 1);
+	FIntPoint NumTiles(FMath::DivideAndRoundUp(RegionSections.X, TileSections), FMath::DivideAndRoundUp(RegionSections.Y, TileSections));
+	FVector2D RegionOrigin = FVector2D(RegionMin) * SectionSize;
+
+	//16 bit RAW needs the range before the first tile is written
+	float HeightMin = 0.0f;
+	float HeightMax = 0.0f;
+	if (!bExr && !(FParse::Value(CmdLine, TEXT("HeightMin="), HeightMin) && FParse::Value(CmdLine, TEXT("HeightMax="), HeightMax)))
+		EstimateHeightRange(NoiseParams, RegionOrigin, RegionOrigin + FVector2D(RegionSections) * SectionSize, HeightMin, HeightMax);
+
+	FString Description = FString::Printf(TEXT("Sections=%d,%d..%d,%d\nTileSections=%d\nSectionSize=%f,%f\nVertexSpacing=%f,%f\nFormat=%s\nSeed=%d\n"),
+		RegionMin.X, RegionMin.Y, RegionMax.X, RegionMax.Y, TileSections, SectionSize.X, SectionSize.Y, VertexSpacing.X, VertexSpacing.Y, bExr ? TEXT("EXR") : TEXT("RAW"), Seed);
+	if (!bExr)
+		Description += FString::Printf(TEXT("HeightMin=%f\nHeightMax=%f\n"), HeightMin, HeightMax);
+	FFileHelper::SaveStringToFile(Description, *(OutDir / TEXT("Region.txt")));
+
+	//Buffers are reused by every tile
+	TArray<float> Heights;
+	TArray<TArray<FVector>> SectionPoints;
+
+	for (int TileY = 0; TileY < NumTiles.Y; TileY++)
+	{
+		for (int TileX = 0; TileX < NumTiles.X; TileX++)
+		{
+			FIntPoint FirstSection = RegionMin + FIntPoint(TileX, TileY) * TileSections;
+			FIntPoint TileSectionCount(FMath::Min(TileSections, RegionMax.X - FirstSection.X + 1), FMath::Min(TileSections, RegionMax.Y - FirstSection.Y + 1));
+			//Neighbouring tiles share their border samples like neighbouring sections do
+			FIntPoint Resolution = TileSectionCount * Components + FIntPoint(1, 1);
+			FVector2D Origin = FVector2D(FirstSection) * SectionSize;
+
+			//Eroded tiles only depend on their coord and the seed, a fresh cache per tile keeps memory flat
+			//at the cost of eroding the tiles on shared borders twice
+			FTerrainNoiseParameters TileNoise = NoiseParams;
+			FTerrainErosionTileSet ErosionTiles;
+			if (NoiseParams.Erosion.IsValid())
+			{
+				TileNoise.Erosion = MakeShared<FTerrainErosionCache, ESPMode::ThreadSafe>(Generator->Erosion, SectionSize, Seed);
+				ErosionTiles = TileNoise.Erosion->GatherTiles(Origin, Origin + FVector2D(TileSectionCount) * SectionSize, TileNoise);
+			}
+
+			Heights.SetNumUninitialized(Resolution.X * Resolution.Y);
+			ParallelFor(Resolution.Y, [&](int32 j)
+			{
+				for (int i = 0; i < Resolution.X; i++)
+				{
+					FVector2D Location = Origin + FVector2D(i, j) * VertexSpacing;
+					float Height = TileNoise.CalculateBaseHeight(Location.X, Location.Y);
+					if (TileNoise.Erosion.IsValid())
+						Height += TileNoise.Erosion->SampleDelta(Location, TileNoise, &ErosionTiles);
+					Heights[i + j * Resolution.X] = Height;
+				}
+			});
+
+			FString TileName = FString::Printf(TEXT("%d_%d"), TileX, TileY);
+			FString HeightPath = OutDir / (TEXT("Height_") + TileName + (bExr ? TEXT(".exr") : TEXT(".r16")));
+			if (!WriteHeightTile(HeightPath, Heights, Resolution, bExr, HeightMin, HeightMax))
+			{
+				UE_LOG(LogTerrainExport, Error, TEXT("Failed to write %s"), *HeightPath);
+				return 1;
+			}
+
+			if (bExportPoints)
+			{
+				//Same points and height cut off the sections use for their foliage
+				int NumSections = TileSectionCount.X * TileSectionCount.Y;
+				SectionPoints.SetNum(NumSections);
+				ParallelFor(NumSections, [&](int32 SectionIndex)
+				{
+					FIntPoint LocalSection(SectionIndex % TileSectionCount.X, SectionIndex / TileSectionCount.X);
+					FIntPoint TerrainCoords = FirstSection + LocalSection;
+					FVector2D SectionOrigin = FVector2D(TerrainCoords) * SectionSize;
+
+					TArray<FVector2D> Points;
+					UDiskSampler::GeneratePoissonPoints(CalcFoliageSeed(Seed, TerrainCoords), SectionSize.X, SectionSize.Y, FOLIAGE_POINT_RADIUS, FOLIAGE_POINT_ATTEMPTS, Points);
+
+					TArray<FVector>& OutPoints = SectionPoints[SectionIndex];
+					OutPoints.Reset();
+					for (const FVector2D& Point : Points)
+					{
+						FVector2D WorldPoint = SectionOrigin + Point;
+						float Height = SampleTileHeight(Heights, Resolution, (WorldPoint - Origin) / VertexSpacing);
+						if (Height < FOLIAGE_MAX_HEIGHT)
+							OutPoints.Add(FVector(WorldPoint, Height));
+					}
+				});
+
+				FString PointText;
+				for (const TArray<FVector>& Points : SectionPoints)
+					for (const FVector& Point : Points)
+						PointText += FString::Printf(TEXT("%f,%f,%f\n"), Point.X, Point.Y, Point.Z);
+
+				FString PointPath = OutDir / (TEXT("Points_") + TileName + TEXT(".csv"));
+				if (!FFileHelper::SaveStringToFile(PointText, *PointPath))
+				{
+					UE_LOG(LogTerrainExport, Error, TEXT("Failed to write %s"), *PointPath);
+					return 1;
+				}
+			}
+
+			UE_LOG(LogTerrainExport, Display, TEXT("Exported tile %d of %d"), TileX + TileY * NumTiles.X + 1, NumTiles.X * NumTiles.Y);
+		}
+	}
+
+	return 0;
+}
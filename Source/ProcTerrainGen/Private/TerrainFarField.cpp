@@ -0,0 +1,129 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainFarField.h"
+
+float FTerrainFarFieldBuilder::CalculateHeight(const FVector2D& Location) const
+{
+	float Height = NoiseParams.CalculateBaseHeight(Location.X, Location.Y);
+	if (Deformation.IsValid())
+		Height += Deformation->SampleDelta(Location);
+
+	return Height;
+}
+
+void FTerrainFarFieldBuilder::Build(FTerrainFarFieldMesh& OutMesh) const
+{
+	OutMesh.Vertices.Reset();
+	OutMesh.Normals.Reset();
+	OutMesh.Indices.Reset();
+
+	int GridSize = Resolution + 1;
+	//One extra sample on every side so edge normals match the neighbouring cells
+	int PaddedSize = GridSize + 2;
+	FVector2D Spacing = SectionSize / Resolution;
+	TArray<float> Heights;
+	Heights.SetNumUninitialized(PaddedSize * PaddedSize);
+
+	for (const FTerrainFarFieldCell& Cell : Cells)
+	{
+		FVector2D Origin = FVector2D(Cell.Coord) * SectionSize;
+		for (int j = 0; j < PaddedSize; j++)
+			for (int i = 0; i < PaddedSize; i++)
+				Heights[i + j * PaddedSize] = CalculateHeight(Origin + FVector2D(i - 1, j - 1) * Spacing);
+
+		int CellStart = OutMesh.Vertices.Num();
+		for (int j = 0; j < GridSize; j++)
+		{
+			for (int i = 0; i < GridSize; i++)
+			{
+				int Padded = (i + 1) + (j + 1) * PaddedSize;
+				FVector2D Location = Origin + FVector2D(i, j) * Spacing;
+				OutMesh.Vertices.Add(FVector3f(Location.X, Location.Y, Heights[Padded]));
+
+				FVector3f Normal((Heights[Padded - 1] - Heights[Padded + 1]) / (2.0f * Spacing.X), (Heights[Padded - PaddedSize] - Heights[Padded + PaddedSize]) / (2.0f * Spacing.Y), 1.0f);
+				OutMesh.Normals.Add(Normal.GetSafeNormal());
+			}
+		}
+
+		//Same winding as the section grids
+		for (int j = 0; j < GridSize - 1; j++)
+		{
+			for (int i = 0; i < GridSize - 1; i++)
+			{
+				int index11 = CellStart + i + j * GridSize;
+				int index12 = CellStart + i + (j + 1) * GridSize;
+				int index13 = CellStart + i + 1 + (j + 1) * GridSize;
+				int index23 = CellStart + i + 1 + j * GridSize;
+
+				OutMesh.Indices.Add(index11);
+				OutMesh.Indices.Add(index12);
+				OutMesh.Indices.Add(index13);
+
+				OutMesh.Indices.Add(index11);
+				OutMesh.Indices.Add(index13);
+				OutMesh.Indices.Add(index23);
+			}
+		}
+
+		//Skirts hide the cracks against the full detail sections, emitted with both windings like section skirts
+		for (int Side = 0; Side < 4; Side++)
+		{
+			if (Cell.ProxyNeighbours & (1 << Side))
+				continue;
+
+			TArray<int32> EdgeIndices;
+			for (int k = 0; k < GridSize; k++)
+			{
+				switch (Side)
+				{
+				case 0: EdgeIndices.Add(CellStart + k * GridSize); break;
+				case 1: EdgeIndices.Add(CellStart + GridSize - 1 + k * GridSize); break;
+				case 2: EdgeIndices.Add(CellStart + k); break;
+				default: EdgeIndices.Add(CellStart + k + (GridSize - 1) * GridSize); break;
+				}
+			}
+
+			int SkirtStart = OutMesh.Vertices.Num();
+			for (int32 EdgeIndex : EdgeIndices)
+			{
+				OutMesh.Vertices.Add(OutMesh.Vertices[EdgeIndex] - FVector3f(0.0f, 0.0f, SkirtDepth));
+				OutMesh.Normals.Add(OutMesh.Normals[EdgeIndex]);
+			}
+
+			for (int k = 0; k < EdgeIndices.Num() - 1; k++)
+			{
+				int Top1 = EdgeIndices[k];
+				int Top2 = EdgeIndices[k + 1];
+				int Bottom1 = SkirtStart + k;
+				int Bottom2 = SkirtStart + k + 1;
+
+				OutMesh.Indices.Add(Top1);
+				OutMesh.Indices.Add(Bottom1);
+				OutMesh.Indices.Add(Top2);
+				OutMesh.Indices.Add(Top2);
+				OutMesh.Indices.Add(Bottom1);
+				OutMesh.Indices.Add(Bottom2);
+
+				OutMesh.Indices.Add(Top1);
+				OutMesh.Indices.Add(Top2);
+				OutMesh.Indices.Add(Bottom1);
+				OutMesh.Indices.Add(Top2);
+				OutMesh.Indices.Add(Bottom2);
+				OutMesh.Indices.Add(Bottom1);
+			}
+		}
+	}
+}
+
+uint32 FTerrainFarFieldBuilder::CalcCellsHash(const TArray<FTerrainFarFieldCell>& Cells)
+{
+	uint32 Hash = GetTypeHash(Cells.Num());
+	for (const FTerrainFarFieldCell& Cell : Cells)
+	{
+		Hash = HashCombine(Hash, GetTypeHash(Cell.Coord));
+		Hash = HashCombine(Hash, GetTypeHash(Cell.ProxyNeighbours));
+	}
+
+	return Hash;
+}
@@ -0,0 +1,105 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainHeightTable.h"
+
+FTerrainHeightTable::FTerrainHeightTable(const FRichCurve& Curve, int Resolution, float MaxError, int MaxResolution)
+{
+	Curve.GetTimeRange(MinTime, MaxTime);
+	if (MaxTime <= MinTime)
+		MaxTime = MinTime + 1.0f;
+
+	//Linear extrapolation is a straight line, one step past either end gives its slope exactly
+	PreExtrap = Curve.PreInfinityExtrap;
+	PostExtrap = Curve.PostInfinityExtrap;
+	PreSlope = PreExtrap == RCCE_Linear ? Curve.Eval(MinTime) - Curve.Eval(MinTime - 1.0f) : 0.0f;
+	PostSlope = PostExtrap == RCCE_Linear ? Curve.Eval(MaxTime + 1.0f) - Curve.Eval(MaxTime) : 0.0f;
+
+	Resolution = FMath::Clamp(Resolution, 1, MaxResolution);
+	MeasuredError = Bake(Curve, Resolution);
+	while (MeasuredError > MaxError && Resolution < MaxResolution)
+	{
+		Resolution = FMath::Min(Resolution * 2, MaxResolution);
+		MeasuredError = Bake(Curve, Resolution);
+	}
+}
+
+float FTerrainHeightTable::Bake(const FRichCurve& Curve, int Resolution)
+{
+	float Step = (MaxTime - MinTime) / Resolution;
+	InvStep = 1.0f / Step;
+
+	Samples.SetNumUninitialized(Resolution + 1);
+	for (int i = 0; i <= Resolution; i++)
+		Samples[i] = Curve.Eval(MinTime + Step * i);
+
+	//Check a few points inside every interval against the curve
+	const int ChecksPerInterval = 4;
+	float Error = 0.0f;
+	for (int i = 0; i < Resolution; i++)
+	{
+		for (int k = 1; k < ChecksPerInterval; k++)
+		{
+			float Time = MinTime + Step * (i + float(k) / ChecksPerInterval);
+			Error = FMath::Max(Error, FMath::Abs(Evaluate(Time) - Curve.Eval(Time)));
+		}
+	}
+
+	return Error;
+}
+
+float FTerrainHeightTable::EvaluateExtrapolated(float Value) const
+{
+	bool bBefore = Value < MinTime;
+	ERichCurveExtrapolation Extrap = bBefore ? PreExtrap : PostExtrap;
+	float Offset = 0.0f;
+
+	switch (Extrap)
+	{
+	case RCCE_Linear:
+		return bBefore ? Samples[0] + (Value - MinTime) * PreSlope : Samples.Last() + (Value - MaxTime) * PostSlope;
+	case RCCE_Cycle:
+	case RCCE_CycleWithOffset:
+	case RCCE_Oscillate:
+	{
+		//Fold the value back into the key range, odd cycles run backwards when oscillating
+		float Range = MaxTime - MinTime;
+		float Cycles = FMath::FloorToFloat((Value - MinTime) / Range);
+		Value -= Cycles * Range;
+		if (Extrap == RCCE_CycleWithOffset)
+			Offset = Cycles * (Samples.Last() - Samples[0]);
+		else if (Extrap == RCCE_Oscillate && FMath::Fmod(Cycles, 2.0f) != 0.0f)
+			Value = MinTime + MaxTime - Value;
+		break;
+	}
+	default:
+		//Constant and none hold the end value
+		break;
+	}
+
+	float Position = FMath::Clamp((Value - MinTime) * InvStep, 0.0f, float(Samples.Num() - 1));
+	int Index = FMath::Min(FMath::FloorToInt(Position), Samples.Num() - 2);
+	return FMath::Lerp(Samples[Index], Samples[Index + 1], Position - Index) + Offset;
+}
+
+uint32 FTerrainHeightTable::CalcCurveHash(const FRichCurve& Curve)
+{
+	uint32 Hash = GetTypeHash(uint8(Curve.PreInfinityExtrap));
+	Hash = HashCombine(Hash, GetTypeHash(uint8(Curve.PostInfinityExtrap)));
+	Hash = HashCombine(Hash, GetTypeHash(Curve.DefaultValue));
+
+	for (const FRichCurveKey& Key : Curve.GetConstRefOfKeys())
+	{
+		Hash = HashCombine(Hash, GetTypeHash(Key.Time));
+		Hash = HashCombine(Hash, GetTypeHash(Key.Value));
+		Hash = HashCombine(Hash, GetTypeHash(Key.ArriveTangent));
+		Hash = HashCombine(Hash, GetTypeHash(Key.LeaveTangent));
+		Hash = HashCombine(Hash, GetTypeHash(Key.ArriveTangentWeight));
+		Hash = HashCombine(Hash, GetTypeHash(Key.LeaveTangentWeight));
+		Hash = HashCombine(Hash, GetTypeHash(uint8(Key.InterpMode)));
+		Hash = HashCombine(Hash, GetTypeHash(uint8(Key.TangentMode)));
+		Hash = HashCombine(Hash, GetTypeHash(uint8(Key.TangentWeightMode)));
+	}
+
+	return Hash;
+}
@@ -0,0 +1,252 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainHeightfield.h"
+#include "LandscapeSection.h"
+
+bool FTerrainHeightfield::Contains(const FVector2D& Location) const
+{
+	FVector2D Max = Origin + VertexSpacing * FVector2D(Components);
+	return Location.X >= Origin.X && Location.Y >= Origin.Y && Location.X <= Max.X && Location.Y <= Max.Y;
+}
+
+float FTerrainHeightfield::SampleHeight(const FVector2D& Location) const
+{
+	//Position in full resolution sample units
+	float LocalX = FMath::Clamp((Location.X - Origin.X) / VertexSpacing.X, 0.0, double(Components.X));
+	float LocalY = FMath::Clamp((Location.Y - Origin.Y) / VertexSpacing.Y, 0.0, double(Components.Y));
+
+	int CellX = FMath::Min(FMath::FloorToInt(LocalX) >> LOD, GridSize.X - 2);
+	int CellY = FMath::Min(FMath::FloorToInt(LocalY) >> LOD, GridSize.Y - 2);
+
+	int X0 = CalcLODSampleIndex(Components.X, LOD, CellX);
+	int X1 = CalcLODSampleIndex(Components.X, LOD, CellX + 1);
+	int Y0 = CalcLODSampleIndex(Components.Y, LOD, CellY);
+	int Y1 = CalcLODSampleIndex(Components.Y, LOD, CellY + 1);
+
+	float TX = (LocalX - X0) / (X1 - X0);
+	float TY = (LocalY - Y0) / (Y1 - Y0);
+
+	float H00 = Heights[CellX + CellY * GridSize.X];
+	float H10 = Heights[CellX + 1 + CellY * GridSize.X];
+	float H01 = Heights[CellX + (CellY + 1) * GridSize.X];
+	float H11 = Heights[CellX + 1 + (CellY + 1) * GridSize.X];
+
+	return FMath::BiLerp(H00, H10, H01, H11, TX, TY);
+}
+
+void FTerrainHeightfield::BuildHeightRanges()
+{
+	HeightRanges.Reset();
+	HeightRangeSizes.Reset();
+
+	//The bilinear surface of a cell never leaves the range of its four corners
+	FIntPoint Cells(GridSize.X - 1, GridSize.Y - 1);
+	TArray<FVector2f>& CellRanges = HeightRanges.AddDefaulted_GetRef();
+	HeightRangeSizes.Add(Cells);
+	CellRanges.SetNumUninitialized(Cells.X * Cells.Y);
+	for (int j = 0; j < Cells.Y; j++)
+	{
+		for (int i = 0; i < Cells.X; i++)
+		{
+			float H00 = Heights[i + j * GridSize.X];
+			float H10 = Heights[i + 1 + j * GridSize.X];
+			float H01 = Heights[i + (j + 1) * GridSize.X];
+			float H11 = Heights[i + 1 + (j + 1) * GridSize.X];
+			CellRanges[i + j * Cells.X] = FVector2f(FMath::Min(FMath::Min(H00, H10), FMath::Min(H01, H11)), FMath::Max(FMath::Max(H00, H10), FMath::Max(H01, H11)));
+		}
+	}
+
+	while (HeightRangeSizes.Last().X > 1 || HeightRangeSizes.Last().Y > 1)
+	{
+		FIntPoint ChildSize = HeightRangeSizes.Last();
+		FIntPoint Size(FMath::DivideAndRoundUp(ChildSize.X, 2), FMath::DivideAndRoundUp(ChildSize.Y, 2));
+		TArray<FVector2f> Ranges;
+		Ranges.SetNumUninitialized(Size.X * Size.Y);
+
+		const TArray<FVector2f>& ChildRanges = HeightRanges.Last();
+		for (int j = 0; j < Size.Y; j++)
+		{
+			for (int i = 0; i < Size.X; i++)
+			{
+				FVector2f Range(MAX_flt, -MAX_flt);
+				for (int ChildY = j * 2; ChildY < FMath::Min(j * 2 + 2, ChildSize.Y); ChildY++)
+				{
+					for (int ChildX = i * 2; ChildX < FMath::Min(i * 2 + 2, ChildSize.X); ChildX++)
+					{
+						const FVector2f& ChildRange = ChildRanges[ChildX + ChildY * ChildSize.X];
+						Range.X = FMath::Min(Range.X, ChildRange.X);
+						Range.Y = FMath::Max(Range.Y, ChildRange.Y);
+					}
+				}
+				Ranges[i + j * Size.X] = Range;
+			}
+		}
+
+		HeightRanges.Add(MoveTemp(Ranges));
+		HeightRangeSizes.Add(Size);
+	}
+}
+
+int64 FTerrainHeightfield::GetAllocatedSize() const
+{
+	int64 Bytes = sizeof(FTerrainHeightfield) + Heights.GetAllocatedSize() + HeightRanges.GetAllocatedSize() + HeightRangeSizes.GetAllocatedSize();
+	for (const TArray<FVector2f>& Ranges : HeightRanges)
+		Bytes += Ranges.GetAllocatedSize();
+
+	return Bytes;
+}
+
+FBox FTerrainHeightfield::GetBounds() const
+{
+	FVector2f Range = HeightRanges.Num() > 0 ? HeightRanges.Last()[0] : FVector2f::ZeroVector;
+	FVector2D Max = Origin + VertexSpacing * FVector2D(Components);
+	return FBox(FVector(Origin, Range.X), FVector(Max, Range.Y));
+}
+
+double FTerrainHeightfield::CalcCellWorldX(int Cell) const
+{
+	return Origin.X + VertexSpacing.X * CalcLODSampleIndex(Components.X, LOD, Cell);
+}
+
+double FTerrainHeightfield::CalcCellWorldY(int Cell) const
+{
+	return Origin.Y + VertexSpacing.Y * CalcLODSampleIndex(Components.Y, LOD, Cell);
+}
+
+//Clips the segment parameter range [0, 1] to a box, axes the segment runs parallel to only have to contain the start
+static bool ClipSegmentToBox(const FVector& Start, const FVector& Delta, const FVector& Min, const FVector& Max, double& OutEnter, double& OutExit)
+{
+	OutEnter = 0.0;
+	OutExit = 1.0;
+	for (int Axis = 0; Axis < 3; Axis++)
+	{
+		if (FMath::Abs(Delta[Axis]) < UE_DOUBLE_SMALL_NUMBER)
+		{
+			if (Start[Axis] < Min[Axis] || Start[Axis] > Max[Axis])
+				return false;
+			continue;
+		}
+
+		double T0 = (Min[Axis] - Start[Axis]) / Delta[Axis];
+		double T1 = (Max[Axis] - Start[Axis]) / Delta[Axis];
+		if (T0 > T1)
+			Swap(T0, T1);
+
+		OutEnter = FMath::Max(OutEnter, T0);
+		OutExit = FMath::Min(OutExit, T1);
+		if (OutEnter > OutExit)
+			return false;
+	}
+
+	return true;
+}
+
+bool FTerrainHeightfield::IntersectSegment(const FVector& Start, const FVector& End, double& OutT) const
+{
+	if (HeightRanges.Num() == 0)
+		return false;
+
+	return IntersectNode(Start, End - Start, HeightRanges.Num() - 1, 0, 0, OutT);
+}
+
+bool FTerrainHeightfield::IntersectNode(const FVector& Start, const FVector& Delta, int Level, int X, int Y, double& OutT) const
+{
+	const FIntPoint& Size = HeightRangeSizes[Level];
+	if (X >= Size.X || Y >= Size.Y)
+		return false;
+
+	//Cells covered by the node, the last node along an axis may cover fewer
+	FIntPoint Cells = HeightRangeSizes[0];
+	int CellMinX = X << Level;
+	int CellMinY = Y << Level;
+	int CellMaxX = FMath::Min((X + 1) << Level, Cells.X);
+	int CellMaxY = FMath::Min((Y + 1) << Level, Cells.Y);
+
+	const FVector2f& Range = HeightRanges[Level][X + Y * Size.X];
+	FVector BoxMin(CalcCellWorldX(CellMinX), CalcCellWorldY(CellMinY), Range.X);
+	FVector BoxMax(CalcCellWorldX(CellMaxX), CalcCellWorldY(CellMaxY), Range.Y);
+
+	double Enter;
+	double Exit;
+	if (!ClipSegmentToBox(Start, Delta, BoxMin, BoxMax, Enter, Exit))
+		return false;
+
+	if (Level == 0)
+		return IntersectCell(Start, Delta, X, Y, Enter, Exit, OutT);
+
+	//Children nearest along the segment first, a straight line can't cross both of the middle two so the first hit is the closest
+	int FirstX = Delta.X >= 0.0 ? 0 : 1;
+	int FirstY = Delta.Y >= 0.0 ? 0 : 1;
+	const FIntPoint ChildOrder[4] = { FIntPoint(FirstX, FirstY), FIntPoint(1 - FirstX, FirstY), FIntPoint(FirstX, 1 - FirstY), FIntPoint(1 - FirstX, 1 - FirstY) };
+	for (const FIntPoint& Child : ChildOrder)
+	{
+		if (IntersectNode(Start, Delta, Level - 1, X * 2 + Child.X, Y * 2 + Child.Y, OutT))
+			return true;
+	}
+
+	return false;
+}
+
+bool FTerrainHeightfield::IntersectCell(const FVector& Start, const FVector& Delta, int X, int Y, double Enter, double Exit, double& OutT) const
+{
+	double X0 = CalcCellWorldX(X);
+	double X1 = CalcCellWorldX(X + 1);
+	double Y0 = CalcCellWorldY(Y);
+	double Y1 = CalcCellWorldY(Y + 1);
+
+	double H00 = Heights[X + Y * GridSize.X];
+	double H10 = Heights[X + 1 + Y * GridSize.X];
+	double H01 = Heights[X + (Y + 1) * GridSize.X];
+	double H11 = Heights[X + 1 + (Y + 1) * GridSize.X];
+
+	//Cell coordinates along the segment are linear in T, so the height above the surface is a quadratic in T
+	double U0 = (Start.X - X0) / (X1 - X0);
+	double UT = Delta.X / (X1 - X0);
+	double V0 = (Start.Y - Y0) / (Y1 - Y0);
+	double VT = Delta.Y / (Y1 - Y0);
+
+	double K1 = H10 - H00;
+	double K2 = H01 - H00;
+	double K3 = H00 - H10 - H01 + H11;
+
+	double C = Start.Z - (H00 + K1 * U0 + K2 * V0 + K3 * U0 * V0);
+	double B = Delta.Z - (K1 * UT + K2 * VT + K3 * (U0 * VT + UT * V0));
+	double A = -K3 * UT * VT;
+
+	auto Above = [A, B, C](double T) { return (A * T + B) * T + C; };
+
+	//Already below the surface where the segment enters the cell
+	if (Above(Enter) <= 0.0)
+	{
+		OutT = Enter;
+		return true;
+	}
+
+	double Root = MAX_dbl;
+	if (FMath::Abs(A) < UE_DOUBLE_SMALL_NUMBER)
+	{
+		if (FMath::Abs(B) > UE_DOUBLE_SMALL_NUMBER)
+			Root = -C / B;
+	}
+	else
+	{
+		double Discriminant = B * B - 4.0 * A * C;
+		if (Discriminant >= 0.0)
+		{
+			double SqrtDiscriminant = FMath::Sqrt(Discriminant);
+			double T0 = (-B - SqrtDiscriminant) / (2.0 * A);
+			double T1 = (-B + SqrtDiscriminant) / (2.0 * A);
+			if (T0 > T1)
+				Swap(T0, T1);
+
+			Root = T0 >= Enter ? T0 : T1;
+		}
+	}
+
+	if (Root < Enter || Root > Exit)
+		return false;
+
+	OutT = Root;
+	return true;
+}
@@ -0,0 +1,34 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainNoise.h"
+#include "TerrainErosion.h"
+#include "SimplexNoise/Public/SimplexNoiseBPLibrary.h"
+
+float FTerrainNoiseParameters::CalculateHeight(float WorldX, float WorldY) const
+{
+	float Height = CalculateBaseHeight(WorldX, WorldY);
+	if (Erosion.IsValid())
+		Height += Erosion->SampleDelta(FVector2D(WorldX, WorldY), *this);
+
+	return Height;
+}
+
+float FTerrainNoiseParameters::CalculateQueryHeight(float WorldX, float WorldY) const
+{
+	float Height = CalculateBaseHeight(WorldX, WorldY);
+	float Delta;
+	if (Erosion.IsValid() && Erosion->SampleCachedDelta(FVector2D(WorldX, WorldY), Delta))
+		Height += Delta;
+
+	return Height;
+}
+
+float FTerrainNoiseParameters::CalculateBaseHeight(float WorldX, float WorldY) const
+{
+	float RawNoiseValue = NoiseGraph.IsValid() ? NoiseGraph->Evaluate(WorldX * NoiseScale, WorldY * NoiseScale)
+		: USimplexNoiseBPLibrary::GetSimplexNoise2D_EX(WorldX * NoiseScale, WorldY * NoiseScale, Lacunarity, Persistance, Octaves, 1.0f, true);
+	float HeightValue = HeightTable.IsValid() ? HeightTable->Evaluate(RawNoiseValue) : RawNoiseValue;
+
+	return HeightValue * HeightScale;
+}
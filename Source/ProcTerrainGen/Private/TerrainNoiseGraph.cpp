@@ -0,0 +1,145 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainNoiseGraph.h"
+#include "SimplexNoise/Public/SimplexNoiseBPLibrary.h"
+#include "Templates/IntegerSequence.h"
+
+namespace TerrainNoiseGraph
+{
+	//Sums the octaves from Octave to NumOctaves, the recursion is resolved at compile time so the loop is fully unrolled
+	template<bool bRidged, int Octave, int NumOctaves>
+	struct TOctaveSum
+	{
+		static FORCEINLINE float Sum(float X, float Y, float Lacunarity, float Persistance, float Frequency, float Amplitude, float& OutMaxAmplitude)
+		{
+			float Noise = USimplexNoiseBPLibrary::SimplexNoise2D(X * Frequency, Y * Frequency);
+			if constexpr (bRidged)
+			{
+				Noise = 1.0f - FMath::Abs(Noise);
+				Noise *= Noise;
+			}
+
+			OutMaxAmplitude += Amplitude;
+			return Noise * Amplitude + TOctaveSum<bRidged, Octave + 1, NumOctaves>::Sum(X, Y, Lacunarity, Persistance, Frequency * Lacunarity, Amplitude * Persistance, OutMaxAmplitude);
+		}
+	};
+
+	template<bool bRidged, int NumOctaves>
+	struct TOctaveSum<bRidged, NumOctaves, NumOctaves>
+	{
+		static FORCEINLINE float Sum(float X, float Y, float Lacunarity, float Persistance, float Frequency, float Amplitude, float& OutMaxAmplitude)
+		{
+			return 0.0f;
+		}
+	};
+
+	//Octave sum normalised by the total amplitude, -1..1 for plain noise and 0..1 for ridged noise
+	template<bool bRidged, int NumOctaves>
+	FORCEINLINE float NormalisedOctaves(const FCompiledNoiseNode& Node, float X, float Y)
+	{
+		float MaxAmplitude = 0.0f;
+		float Sum = TOctaveSum<bRidged, 0, NumOctaves>::Sum(X * Node.Frequency + Node.OffsetX, Y * Node.Frequency + Node.OffsetY, Node.Lacunarity, Node.Persistance, 1.0f, 1.0f, MaxAmplitude);
+		return Sum / MaxAmplitude;
+	}
+
+	template<ETerrainNoiseNodeType Type, int NumOctaves>
+	struct TNoiseNodeKernel;
+
+	template<int NumOctaves>
+	struct TNoiseNodeKernel<ETerrainNoiseNodeType::Fbm, NumOctaves>
+	{
+		static void Evaluate(const FCompiledNoiseNode& Node, FNoiseGraphState& State)
+		{
+			State.Height += Node.Amplitude * (NormalisedOctaves<false, NumOctaves>(Node, State.X, State.Y) * 0.5f + 0.5f);
+		}
+	};
+
+	template<int NumOctaves>
+	struct TNoiseNodeKernel<ETerrainNoiseNodeType::Ridged, NumOctaves>
+	{
+		static void Evaluate(const FCompiledNoiseNode& Node, FNoiseGraphState& State)
+		{
+			State.Height += Node.Amplitude * NormalisedOctaves<true, NumOctaves>(Node, State.X, State.Y);
+		}
+	};
+
+	template<int NumOctaves>
+	struct TNoiseNodeKernel<ETerrainNoiseNodeType::DomainWarp, NumOctaves>
+	{
+		static void Evaluate(const FCompiledNoiseNode& Node, FNoiseGraphState& State)
+		{
+			//Two decorrelated samples give the warp direction
+			float WarpX = NormalisedOctaves<false, NumOctaves>(Node, State.X, State.Y);
+			float WarpY = NormalisedOctaves<false, NumOctaves>(Node, State.X + 5.2f, State.Y + 1.3f);
+			State.X += WarpX * Node.Amplitude;
+			State.Y += WarpY * Node.Amplitude;
+		}
+	};
+
+	template<int NumOctaves>
+	struct TNoiseNodeKernel<ETerrainNoiseNodeType::BiomeBlend, NumOctaves>
+	{
+		static void Evaluate(const FCompiledNoiseNode& Node, FNoiseGraphState& State)
+		{
+			float Mask = FMath::SmoothStep(0.0f, 1.0f, NormalisedOctaves<false, NumOctaves>(Node, State.X, State.Y) * 0.5f + 0.5f);
+			State.Height *= FMath::Lerp(1.0f, Node.Amplitude, Mask);
+		}
+	};
+
+	//Table of every octave specialization of a node type
+	template<ETerrainNoiseNodeType Type, int... OctaveIndices>
+	FNoiseNodeKernel SelectKernel(int NumOctaves, TIntegerSequence<int, OctaveIndices...>)
+	{
+		static const FNoiseNodeKernel Kernels[] = { &TNoiseNodeKernel<Type, OctaveIndices + 1>::Evaluate... };
+		return Kernels[FMath::Clamp(NumOctaves, 1, MAX_NOISE_GRAPH_OCTAVES) - 1];
+	}
+
+	FNoiseNodeKernel SelectKernel(ETerrainNoiseNodeType Type, int NumOctaves)
+	{
+		switch (Type)
+		{
+		case ETerrainNoiseNodeType::Ridged:
+			return SelectKernel<ETerrainNoiseNodeType::Ridged>(NumOctaves, TMakeIntegerSequence<int, MAX_NOISE_GRAPH_OCTAVES>());
+		case ETerrainNoiseNodeType::DomainWarp:
+			return SelectKernel<ETerrainNoiseNodeType::DomainWarp>(NumOctaves, TMakeIntegerSequence<int, MAX_NOISE_GRAPH_OCTAVES>());
+		case ETerrainNoiseNodeType::BiomeBlend:
+			return SelectKernel<ETerrainNoiseNodeType::BiomeBlend>(NumOctaves, TMakeIntegerSequence<int, MAX_NOISE_GRAPH_OCTAVES>());
+		default:
+			return SelectKernel<ETerrainNoiseNodeType::Fbm>(NumOctaves, TMakeIntegerSequence<int, MAX_NOISE_GRAPH_OCTAVES>());
+		}
+	}
+}
+
+FCompiledNoiseGraph::FCompiledNoiseGraph(const TArray<FTerrainNoiseNode>& Nodes)
+{
+	CompiledNodes.Reserve(Nodes.Num());
+	for (const FTerrainNoiseNode& Node : Nodes)
+	{
+		FCompiledNoiseNode& Compiled = CompiledNodes.AddDefaulted_GetRef();
+		Compiled.Kernel = TerrainNoiseGraph::SelectKernel(Node.Type, Node.Octaves);
+		Compiled.Frequency = Node.Frequency;
+		Compiled.Lacunarity = Node.Lacunarity;
+		Compiled.Persistance = Node.Persistance;
+		Compiled.Amplitude = Node.Amplitude;
+		Compiled.OffsetX = Node.Offset.X;
+		Compiled.OffsetY = Node.Offset.Y;
+	}
+}
+
+uint32 FCompiledNoiseGraph::CalcGraphHash(const TArray<FTerrainNoiseNode>& Nodes)
+{
+	uint32 Hash = GetTypeHash(Nodes.Num());
+	for (const FTerrainNoiseNode& Node : Nodes)
+	{
+		Hash = HashCombine(Hash, GetTypeHash(uint8(Node.Type)));
+		Hash = HashCombine(Hash, GetTypeHash(Node.Octaves));
+		Hash = HashCombine(Hash, GetTypeHash(Node.Frequency));
+		Hash = HashCombine(Hash, GetTypeHash(Node.Lacunarity));
+		Hash = HashCombine(Hash, GetTypeHash(Node.Persistance));
+		Hash = HashCombine(Hash, GetTypeHash(Node.Amplitude));
+		Hash = HashCombine(Hash, GetTypeHash(Node.Offset));
+	}
+
+	return Hash;
+}
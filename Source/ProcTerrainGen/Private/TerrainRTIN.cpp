@@ -0,0 +1,112 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TerrainRTIN.h"
+
+bool FTerrainRTIN::SupportsGridSize(const FIntPoint& GridSize)
+{
+	return GridSize.X == GridSize.Y && GridSize.X > 2 && FMath::IsPowerOfTwo(GridSize.X - 1);
+}
+
+FTerrainRTIN::FTerrainRTIN(const TArray<FVector3f>& Vertices, int InGridSize)
+	: GridSize(InGridSize)
+{
+	int TileSize = GridSize - 1;
+	int NumTriangles = TileSize * TileSize * 2 - 2;
+	int NumParentTriangles = NumTriangles - TileSize * TileSize;
+
+	Errors.SetNumZeroed(GridSize * GridSize);
+
+	//Border vertices can never be dropped, their parents inherit the error so every triangle touching the border is split
+	for (int i = 0; i < GridSize; i++)
+	{
+		Errors[i] = MAX_flt;
+		Errors[TileSize * GridSize + i] = MAX_flt;
+		Errors[i * GridSize] = MAX_flt;
+		Errors[i * GridSize + TileSize] = MAX_flt;
+	}
+
+	//Triangles are numbered so children always come after their parents, walking backwards fills in the errors bottom up
+	for (int i = NumTriangles - 1; i >= 0; i--)
+	{
+		int Id = i + 2;
+		int AX = 0, AY = 0, BX = 0, BY = 0, CX = 0, CY = 0;
+		if (Id & 1)
+		{
+			BX = BY = CX = TileSize;
+		}
+		else
+		{
+			AX = AY = CY = TileSize;
+		}
+
+		while ((Id >>= 1) > 1)
+		{
+			int MX = (AX + BX) >> 1;
+			int MY = (AY + BY) >> 1;
+			if (Id & 1)
+			{
+				BX = AX; BY = AY;
+				AX = CX; AY = CY;
+			}
+			else
+			{
+				AX = BX; AY = BY;
+				BX = CX; BY = CY;
+			}
+			CX = MX;
+			CY = MY;
+		}
+
+		int MX = (AX + BX) >> 1;
+		int MY = (AY + BY) >> 1;
+		int MiddleIndex = MY * GridSize + MX;
+
+		float InterpolatedHeight = (Vertices[AY * GridSize + AX].Z + Vertices[BY * GridSize + BX].Z) * 0.5f;
+		float MiddleError = FMath::Abs(InterpolatedHeight - Vertices[MiddleIndex].Z);
+		Errors[MiddleIndex] = FMath::Max(Errors[MiddleIndex], MiddleError);
+
+		if (i < NumParentTriangles)
+		{
+			int ApexX = MX + MY - AY;
+			int ApexY = MY + AX - MX;
+			int LeftChildIndex = ((AY + ApexY) >> 1) * GridSize + ((AX + ApexX) >> 1);
+			int RightChildIndex = ((BY + ApexY) >> 1) * GridSize + ((BX + ApexX) >> 1);
+			Errors[MiddleIndex] = FMath::Max3(Errors[MiddleIndex], Errors[LeftChildIndex], Errors[RightChildIndex]);
+		}
+	}
+}
+
+void FTerrainRTIN::Triangulate(float MaxError, TArray<int32>& OutIndices) const
+{
+	int TileSize = GridSize - 1;
+	ProcessTriangle(0, 0, TileSize, TileSize, TileSize, 0, MaxError, OutIndices);
+	ProcessTriangle(TileSize, TileSize, 0, 0, 0, TileSize, MaxError, OutIndices);
+}
+
+void FTerrainRTIN::ProcessTriangle(int AX, int AY, int BX, int BY, int CX, int CY, float MaxError, TArray<int32>& OutIndices) const
+{
+	int MX = (AX + BX) >> 1;
+	int MY = (AY + BY) >> 1;
+
+	if (FMath::Abs(AX - CX) + FMath::Abs(AY - CY) > 1 && Errors[MY * GridSize + MX] > MaxError)
+	{
+		ProcessTriangle(CX, CY, AX, AY, MX, MY, MaxError, OutIndices);
+		ProcessTriangle(BX, BY, CX, CY, MX, MY, MaxError, OutIndices);
+		return;
+	}
+
+	//The uniform grid emits triangles with a negative signed area in grid space, match it so both face the same way
+	int SignedArea = (BX - AX) * (CY - AY) - (BY - AY) * (CX - AX);
+	OutIndices.Add(AY * GridSize + AX);
+	if (SignedArea < 0)
+	{
+		OutIndices.Add(BY * GridSize + BX);
+		OutIndices.Add(CY * GridSize + CX);
+	}
+	else
+	{
+		OutIndices.Add(CY * GridSize + CX);
+		OutIndices.Add(BY * GridSize + BX);
+	}
+}
@@ -12,7 +12,7 @@ public class ProcTerrainGen : ModuleRules
 		PublicDependencyModuleNames.Add("SimplexNoise");
 		PublicDependencyModuleNames.Add("RuntimeMeshComponent");
 
-		PrivateDependencyModuleNames.AddRange(new string[] {  });
+		PrivateDependencyModuleNames.AddRange(new string[] { "ImageWrapper", "RenderCore" });
 
 		// Uncomment if you are using Slate UI
 		// PrivateDependencyModuleNames.AddRange(new string[] { "Slate", "SlateCore" });
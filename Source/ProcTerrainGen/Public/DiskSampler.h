@@ -13,19 +13,6 @@ UCLASS(Blueprintable, BlueprintType, Category = "Disk Sampler")
 class PROCTERRAINGEN_API UDiskSampler : public UObject
 {
 	GENERATED_BODY()
-
-	int mRows;
-	int mColumns;
-	float mWidth;
-	float mHeight;
-	int mRadius;
-	float mCellSize;
-
-	FIntPoint GetGridCellFromPosition(const FVector2D& Position);
-	bool IsPointValid(const FVector2D& Point);
-
-	int* DataGrid;
-	TArray<FVector2D> ActiveList;
 	
 public:
 
@@ -35,4 +22,7 @@ public:
 	UFUNCTION(BlueprintCallable, Category="Disk Sampler")
 	void GeneratePoints(int64 seed, float width, float height, float radius, int k);
 
+	//Poisson disk sampling without any shared state, safe to call from any thread
+	static void GeneratePoissonPoints(int64 seed, float width, float height, float radius, int k, TArray<FVector2D>& OutPoints);
+
 };
@@ -4,51 +4,489 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
+#include "TerrainNoise.h"
+#include "TerrainHeightfield.h"
+#include "TerrainErosion.h"
+#include "TerrainDeformation.h"
+#include "TerrainFarField.h"
+#include "Async/Future.h"
 #include "LandscapeGenerator.generated.h"
 
 FVector2D CalculateWorldCoordinatesFromTerrainCoords(const FIntPoint& TerrainCoords, const FVector2D& SectionSize);
 
 class ALandscapeSection;
 class AActor;
+class UCurveFloat;
+class URuntimeMeshComponent;
+class URuntimeMeshProviderStatic;
 
 DECLARE_DYNAMIC_MULTICAST_DELEGATE(FGeneratedDelegate);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FWarmupProgressDelegate, float, Percent, int32, CompletedSections);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FTerrainDivergenceDelegate, FIntVector, Node);
+
+//Something terrain is streamed around, such as a player pawn or a registered anchor actor
+struct FTerrainStreamingSource
+{
+	FVector Location;
+	//Visible radius in sections
+	int Radius;
+	FVector Velocity = FVector::ZeroVector;
+	//Where the source will be after PrefetchHorizon, clamped to PrefetchMaxSections. Same as Location when standing still
+	FVector PrefetchLocation = FVector::ZeroVector;
+};
+
+struct FTerrainStreamingAnchor
+{
+	TWeakObjectPtr<AActor> Actor;
+	int Radius;
+};
+
+//Merged visibility of a grid coord over all streaming sources
+struct FVisibleCoordInfo
+{
+	//Finest LOD any source needs
+	int LODLevel;
+	//Number of sources that can see the coord
+	int SourceCount;
+	//Distance in sections to the closest source
+	float Distance;
+};
+
+//Far field sections merged into one mesh section of the proxy component
+struct FTerrainFarFieldChunk
+{
+	//Sorted by coord so the hash only changes with the membership
+	TArray<FTerrainFarFieldCell> Cells;
+	//Bumped when the surface under the chunk changes, folded into CellsHash so the chunk is rebuilt
+	uint32 Revision = 0;
+	uint32 CellsHash = 0;
+	//Hash of the cells the displayed mesh was built from
+	uint32 BuiltHash = 0;
+	int32 MeshSection = INDEX_NONE;
+
+	bool bBuilding = false;
+	uint32 BuildingHash = 0;
+	TFuture<FTerrainFarFieldMesh> PendingMesh;
+};
+
+UENUM(BlueprintType)
+enum class ETerrainGenerationMode : uint8
+{
+	//Flat grid of equally sized sections around the player
+	Grid,
+	//Quadtree of sections, distant nodes cover exponentially larger areas at the same vertex count
+	Quadtree
+};
+
+UENUM(BlueprintType)
+enum class ETerrainDeformationMode : uint8
+{
+	Raise,
+	Lower,
+	//Pulls the surface towards the height given as the amount
+	Flatten
+};
+
+//Kinds of game thread work a section queues, a newer request replaces a queued one of the same kind
+enum class ETerrainUploadType : uint8
+{
+	Collision,
+	RenderMesh,
+	Foliage,
+	//Moves existing foliage instances onto a deformed surface
+	FoliageTransforms,
+	Material
+};
+
+UENUM(BlueprintType)
+enum class ETerrainThrottleDecision : uint8
+{
+	Hold,
+	//Frame time had headroom, more jobs or a larger upload budget were allowed
+	Increase,
+	//Frame time reached the target, jobs and the upload budget were cut back
+	Decrease
+};
+
+struct FTerrainUploadRequest
+{
+	TWeakObjectPtr<ALandscapeSection> Section;
+	ETerrainUploadType Type;
+	//Estimated bytes handed to the renderer or physics
+	int64 Bytes;
+	TFunction<void()> Work;
+};
+
+USTRUCT(BlueprintType)
+struct FTerrainUploadStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Uploads")
+	int32 QueuedRequests = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Uploads")
+	int32 LastFrameRequests = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Uploads")
+	int64 LastFrameBytes = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Uploads")
+	float LastFrameMilliseconds = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Uploads")
+	float MaxFrameMilliseconds = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Uploads")
+	int64 TotalRequests = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Uploads")
+	int64 TotalBytes = 0;
+};
+
+//Adaptive throttling state, refreshed every tick while generating
+USTRUCT(BlueprintType)
+struct FTerrainThrottleStats
+{
+	GENERATED_BODY()
+
+	//Smoothed game thread time, in milliseconds
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Throttling")
+	float FrameMilliseconds = 0.0f;
+
+	//Smoothed fraction of the job limit that was in use
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Throttling")
+	float WorkerUtilisation = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Throttling")
+	int32 JobLimit = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Throttling")
+	float UploadBudgetMilliseconds = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Throttling")
+	int64 UploadBudgetBytes = 0;
+
+	//Sections spawned per grid or quadtree pass
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Throttling")
+	int32 SectionsPerPass = 1;
+
+	//Seconds between grid or quadtree passes
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Throttling")
+	float GenerationInterval = 0.0f;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Throttling")
+	ETerrainThrottleDecision LastDecision = ETerrainThrottleDecision::Hold;
+
+	//Number of decisions in each direction since generation started
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Throttling")
+	int32 Increases = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Throttling")
+	int32 Decreases = 0;
+};
+
+//CPU side terrain memory, refreshed every tick while generating
+USTRUCT(BlueprintType)
+struct FTerrainMemoryStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Memory")
+	int64 MeshDataBytes = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Memory")
+	int64 LODDataBytes = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Memory")
+	int64 CollisionDataBytes = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Memory")
+	int64 FoliagePointBytes = 0;
+
+	//Heightfields and erosion tiles count against the budget but are never evicted by it
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Memory")
+	int64 HeightfieldBytes = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Memory")
+	int64 ErosionTileBytes = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Memory")
+	int64 TotalBytes = 0;
+
+	//Number of evictions per category since generation started
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Memory")
+	int32 MeshDataEvictions = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Memory")
+	int32 LODDataEvictions = 0;
+
+	UPROPERTY(BlueprintReadOnly, Category = "Terrain Memory")
+	int32 CollisionDataEvictions = 0;
+};
+
+//Everything a client needs to generate the same terrain as the server, replicated instead of any geometry
+USTRUCT(BlueprintType)
+struct FTerrainReplicatedSettings
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	bool bValid = false;
+
+	UPROPERTY()
+	int32 NoiseSeed = 0;
+
+	UPROPERTY()
+	float NoiseScale = 0.1f;
+
+	UPROPERTY()
+	float HeightScale = 1.0f;
+
+	UPROPERTY()
+	float Lacunarity = 2.3f;
+
+	UPROPERTY()
+	float Persistance = 0.6f;
+
+	UPROPERTY()
+	int32 Octaves = 4;
+
+	UPROPERTY()
+	UCurveFloat* TerrainHeight = nullptr;
+
+	UPROPERTY()
+	TArray<FTerrainNoiseNode> NoiseGraph;
+
+	UPROPERTY()
+	FTerrainErosionSettings Erosion;
+
+	UPROPERTY()
+	FVector2D LandscapeSectionSize = FVector2D::ZeroVector;
+
+	UPROPERTY()
+	FIntPoint LandscapeComponentSize = FIntPoint::ZeroValue;
+};
+
+//Checksum of the heights and foliage points a section generated, compared between server and clients
+USTRUCT(BlueprintType)
+struct FTerrainSectionChecksum
+{
+	GENERATED_BODY()
+
+	//Section coords and quadtree level
+	UPROPERTY(BlueprintReadOnly, Category = "Landscape Network")
+	FIntVector Node = FIntVector::ZeroValue;
+
+	//Heights on a fixed reference lattice, independent of the LOD the section was generated at
+	UPROPERTY(BlueprintReadOnly, Category = "Landscape Network")
+	int32 HeightChecksum = 0;
+
+	//Foliage points derived from the section's foliage seed, zero for quadtree nodes above the base level
+	UPROPERTY(BlueprintReadOnly, Category = "Landscape Network")
+	int32 PointsChecksum = 0;
+};
 
 UCLASS()
 class PROCTERRAINGEN_API ALandscapeGenerator : public AActor
 {
 	GENERATED_BODY()
 
-	FIntPoint CalcVisibleGridPoints(const FVector& PlayerLocation);
+	TArray<FTerrainStreamingSource> GatherStreamingSources();
+	float CalcDistanceToStreamingSources(const FVector2D& Location, const TArray<FTerrainStreamingSource>& Sources);
+	void AddStreamingSource(TArray<FTerrainStreamingSource>& Sources, const FVector& Location, const FVector& Velocity, int Radius);
+	//Distance from a box to the path between a source and its prefetch location
+	float CalcDistanceToSourcePath(const FBox2D& Bounds, const FTerrainStreamingSource& Source);
+	void CalcVisibleGridPoints(const TArray<FTerrainStreamingSource>& Sources);
 	void GenerateNewTerrainGrid();
+	void RemoveSectionObject(ALandscapeSection* SectionObject);
+	ALandscapeSection* SpawnGridSection(const FIntPoint& Coord, int LODLevel, int InitialLOD);
+	ALandscapeSection* SpawnQuadtreeNode(const FIntVector& Node);
+	void CalcVisibleQuadtreeNodes(const TArray<FTerrainStreamingSource>& Sources);
+
+	void BeginWarmup();
+	void UpdateWarmup();
+	void DispatchPendingOperations();
 	ALandscapeSection* DoesTerrainCoordExist(const FIntPoint& TerrainCoord);
 	bool IsTerrainCoordVisible(const FIntPoint& Coord);
 	bool IsCloseForCollision(const FIntPoint& Coords, const FVector& PlayerLocation);
 	int CalcLODLevelFromTerrainCoordDistance(float Distance);
 
+	void GenerateNewQuadtreeNodes();
+	void CollectQuadtreeLeaves(const FIntVector& Node, const TArray<FTerrainStreamingSource>& Sources, TArray<FIntVector>& OutLeaves);
+	FBox2D CalcQuadtreeNodeBounds(const FIntVector& Node);
+	ALandscapeSection* DoesQuadtreeNodeExist(const FIntVector& Node);
+	bool IsQuadtreeNodeCovered(const FIntVector& Node);
+	int64 CalcGridTriangleCount(float RingScale, int64& OutVertexCount);
+	void UpdateLODRingsFromBudget();
+
+	TArray<FTerrainUploadRequest> UploadQueue;
+	FTerrainUploadStats UploadStats;
+	//Applies queued uploads, closest sections first, until the frame's time or byte budget is spent
+	void ProcessUploadQueue();
+
+	FTerrainThrottleStats ThrottleStats;
+	float ThrottleTimer;
+	//Fraction of UploadBudgetMilliseconds and UploadBudgetBytes currently allowed
+	float ThrottleUploadScale;
+	//Measures frame time and worker use, then moves the job limit, upload budget and spawn rate towards TargetFrameMilliseconds
+	void UpdateThrottling(float DeltaTime);
+	//Job limit from MaxConcurrentJobs, or the core count when it is zero
+	int CalcMaxJobs() const;
+	//Set when the last pass stopped at SectionsPerPass with visible sections still missing
+	bool bGenerationBacklog;
+	//Set while even the tightest LOD rings leave the visible set over budget, so the warning is logged once
+	bool bLODBudgetExceeded;
+
+	FTerrainMemoryStats MemoryStats;
+	//Refreshes MemoryStats and evicts least recently used section data while over TerrainMemoryBudgetMB
+	void EnforceMemoryBudget();
+
 	TArray<FVector> LandscapeVertices;
 	TArray<int32> LandscapeIndices;
 	TArray<FVector> LandscapeNormals;
 	TArray<FIntPoint> VisibleGridCoords;
+	TMap<FIntPoint, FVisibleCoordInfo> VisibleCoordInfo;
+	//Visible coords beyond FarFieldRing, drawn by the far field proxy instead of their own sections
+	TSet<FIntPoint> FarFieldCoords;
+
+	UPROPERTY()
+	URuntimeMeshComponent* FarFieldMesh;
+	UPROPERTY()
+	URuntimeMeshProviderStatic* FarFieldProvider;
+	TMap<FIntPoint, FTerrainFarFieldChunk> FarFieldChunks;
+	TArray<int32> FreeFarFieldSections;
+	int32 NextFarFieldSection;
+
+	bool IsFarFieldActive() const;
+	//Regroups FarFieldCoords into chunks and starts building the ones that changed
+	void UpdateFarField();
+	//Displays finished chunk builds and drops chunks that are no longer needed
+	void ProcessFarField();
+	void ClearFarField();
+	//Rebuilds the chunks overlapping Area on the next grid pass, every chunk when Area is null
+	void MarkFarFieldDirty(const FBox2D* Area);
+	TArray<FTerrainStreamingAnchor> StreamingAnchors;
+	//Every section keyed by (X, Y, Level), grid sections are always level 0
+	TMap<FIntVector, ALandscapeSection*> SectionLookup;
+	//Quadtree leaves as (X, Y, Level), coords are in units of the node size at that level
+	TArray<FIntVector> VisibleQuadtreeNodes;
 	
+	//Baked TerrainHeight curve shared with the sections, replaced as a whole when the curve changes
+	TSharedPtr<const FTerrainHeightTable, ESPMode::ThreadSafe> TerrainHeightTable;
+	UCurveFloat* BakedTerrainHeightCurve;
+	uint32 BakedTerrainHeightHash;
+
+	//Compiled NoiseGraph shared with the sections, recompiled as a whole when a node changes
+	TSharedPtr<const FCompiledNoiseGraph, ESPMode::ThreadSafe> CompiledNoiseGraph;
+	uint32 CompiledNoiseGraphHash;
+
+	//Sections generated locally that have not been compared yet, dropped when the section is removed
+	TMap<FIntVector, FTerrainSectionChecksum> LocalChecksums;
+	//Mirror of ServerChecksums keyed by node, rebuilt on every replication
+	TMap<FIntVector, FTerrainSectionChecksum> RemoteChecksums;
+	void CompareChecksums(const FIntVector& Node);
+
+	//ServerChecksums is a ring, entries are overwritten in place so only the changed element replicates
+	int32 NextServerChecksum;
+	TMap<FIntVector, int32> ServerChecksumIndices;
+
+	//Copies the generation settings into ReplicatedSettings, server only
+	void CaptureReplicatedSettings();
+
+	UFUNCTION()
+	void OnRep_ReplicatedSettings();
+
+	UFUNCTION()
+	void OnRep_ServerChecksums();
+
+	//Eroded tiles shared with the sections, dropped whenever the noise changes
+	TSharedPtr<FTerrainErosionCache, ESPMode::ThreadSafe> ErosionCache;
+
+	//Edits made at runtime, kept for the lifetime of the generator so regenerated sections include them
+	TSharedPtr<FTerrainDeformation, ESPMode::ThreadSafe> Deformation;
+
+	//Heightfields of resident sections keyed by (X, Y, Level), guarded by HeightfieldLock
+	mutable FRWLock HeightfieldLock;
+	TMap<FIntVector, TSharedPtr<const FTerrainHeightfield, ESPMode::ThreadSafe>> ResidentHeightfields;
+	FTerrainNoiseParameters QueryNoiseParameters;
+	void UpdateQueryNoiseParameters();
+
+	//Expects HeightfieldLock to be held for reading
+	float SampleHeightLocked(const FVector2D& Location, const FTerrainNoiseParameters& NoiseParams) const;
+	FVector SampleNormalLocked(const FVector2D& Location, const FTerrainNoiseParameters& NoiseParams) const;
+
 	int NoiseSeed;
+	//Set when StartGeneration is called on a client before the server's settings arrived
+	bool bGenerationRequested;
 	bool mGenerating;
 	bool bCanGenerate;
 
+	bool bWarmingUp;
+	int WarmupTotalSections;
+	int WarmupCompletedSections;
+	float GenerationTimer;
+
 public:	
 	// Sets default values for this actor's properties
 	ALandscapeGenerator();
-	float ApplyTerrainHeightMultiplier(float value);
+
+	//True when sections only build collision, either forced or because this is a dedicated server
+	bool IsCollisionOnly() const;
+	bool UseQuadtree() const;
+
+	//Rebakes the TerrainHeight lookup table if the curve asset changed, game thread only
+	void RefreshTerrainHeightTable();
+	TSharedPtr<const FTerrainHeightTable, ESPMode::ThreadSafe> GetTerrainHeightTable() const { return TerrainHeightTable; }
+
+	//Recompiles NoiseGraph if any node changed, game thread only
+	void RefreshNoiseGraph();
+
+	//Noise settings handed to new sections, game thread only
+	FTerrainNoiseParameters GetNoiseParameters() const;
+
+	//Noise settings built from the properties alone, without the cached tables or a world. Used on the class default object by tools
+	FTerrainNoiseParameters MakeStandaloneNoiseParameters(int Seed) const;
+
+	//Called by sections from worker threads once their heights are generated
+	void PublishHeightfield(const FIntVector& Node, TSharedPtr<const FTerrainHeightfield, ESPMode::ThreadSafe> Heightfield);
+	void RemoveHeightfield(const FIntVector& Node, const FTerrainHeightfield* Heightfield);
+
+	//Worker slots, reserved on the game thread and released by the worker when its job finishes
+	bool TryReserveJob();
+
+	//Queues game thread work for a section, replacing any queued request of the same type
+	void EnqueueUpload(ALandscapeSection* Section, ETerrainUploadType Type, int64 Bytes, TFunction<void()> Work);
+	//Drops everything queued for a section, called before it is removed
+	void CancelUploads(ALandscapeSection* Section);
+	FThreadSafeCounter ActiveJobs;
 	FIntPoint GetCurrentGridPoint(const FVector& PlayerLocation);
 
 	//Get landscape material
 	UMaterialInterface* GetMaterial();
 
+	TSharedPtr<FTerrainDeformation, ESPMode::ThreadSafe> GetDeformation() const { return Deformation; }
+
+	//Called by sections on the game thread once their mesh data is generated
+	void RecordSectionChecksum(const FTerrainSectionChecksum& SectionChecksum);
+
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Properties")
 	bool AddFoliage;
 
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Properties")
 	bool AddCollision;
 
+	//Only build collision and foliage collision, no normals, LODs or render sections
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Properties")
+	bool bCollisionOnly;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Properties")
+	bool bCollisionOnlyOnDedicatedServer;
+
+	//Radius in sections around each player generated in collision only mode
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Properties")
+	int CollisionOnlyRadius;
+
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Properties")
 	UStaticMesh* TreeMesh;
 
@@ -70,6 +508,102 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Properties")
 	int GenerationLevel;
 
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Properties")
+	ETerrainGenerationMode GenerationMode;
+
+	//Seconds between grid updates once warm-up has finished
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Properties")
+	float GenerationInterval;
+
+	//Generation jobs allowed to run at once, 0 uses one per worker core
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Properties")
+	int MaxConcurrentJobs;
+
+	//Build the whole initial visible set across all cores when generation starts
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Properties")
+	bool bFastStartWarmUp;
+
+	//Seconds of movement each streaming source is extrapolated along its velocity, sections on the way are generated before it arrives. 0 disables
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Properties")
+	float PrefetchHorizon;
+
+	//Furthest a source is extrapolated, in sections, so a teleport or fall can't stream a whole new region
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Properties")
+	float PrefetchMaxSections;
+
+	//Number of quadtree levels above the base section size
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Quadtree")
+	int QuadtreeDepth;
+
+	//Root nodes generated around the player's root node along each axis
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Quadtree")
+	int QuadtreeRootExtent;
+
+	//A node is split while the player is closer than this many node sizes
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Quadtree")
+	float QuadtreeSplitDistance;
+
+	//Depth of the skirts hiding cracks between nodes of different sizes
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Quadtree")
+	float QuadtreeSkirtDepth;
+
+	//Merge every section beyond FarFieldRing into a few low resolution proxy meshes instead of spawning them, grid mode only
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Far Field")
+	bool bFarFieldProxy;
+
+	//Distance in sections beyond which the far field proxy takes over
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Far Field", meta = (ClampMin = "1"))
+	int FarFieldRing;
+
+	//Sections per axis merged into one proxy chunk, a chunk is rebuilt as a whole when any of its sections changes
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Far Field", meta = (ClampMin = "1"))
+	int FarFieldChunkSections;
+
+	//Quads per section along each axis in the proxy
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Far Field", meta = (ClampMin = "1"))
+	int FarFieldResolution;
+
+	//Chunk builds running at the same time
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Far Field", meta = (ClampMin = "1"))
+	int FarFieldMaxBuilds;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Far Field")
+	float FarFieldSkirtDepth;
+
+	//Highest LOD a section can be displayed at
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape LOD")
+	int MaxLODLevel;
+
+	//Distance in sections at which each LOD ring starts, element i is where LOD i + 1 begins
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape LOD")
+	TArray<float> LODRingDistances;
+
+	//Generate new sections directly at their ring LOD instead of building full resolution data first,
+	//they are refined to finer LODs as the player approaches
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape LOD")
+	bool bGenerateAtRingLOD;
+
+	//Show new sections as a coarse proxy at MaxLODLevel first and refine them as their jobs complete
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape LOD")
+	bool bProgressiveStreaming;
+
+	//Triangulate sections with an error driven right-triangle network instead of a uniform grid.
+	//LandscapeComponentSize must be square and a power of two (e.g. 64 or 128), otherwise the uniform grid is used and a warning is logged
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape LOD")
+	bool bAdaptiveMesh;
+
+	//Largest height error in world units the adaptive mesh may have at full resolution, doubled for every LOD
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape LOD")
+	float AdaptiveMeshMaxError;
+
+	//Grid mode only. If non zero, LOD ring distances are picked every pass so the visible sections stay within this many triangles
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape LOD")
+	int64 TargetTriangleBudget;
+
+	//Grid mode only. If non zero, LOD ring distances are picked every pass so the visible sections stay within this many vertices
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape LOD")
+	int64 TargetVertexBudget;
+
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Noise")
 	float fPersistance;
 
@@ -88,14 +622,129 @@ public:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Noise")
 	UCurveFloat *TerrainHeight;
 
+	//Layered noise evaluated in order, replaces the single fBm above when not empty. Sampled at world position * fNoiseScale
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Noise")
+	TArray<FTerrainNoiseNode> NoiseGraph;
+
+	//Hydraulic and thermal erosion run on overlapping tiles so neighbouring sections agree at their borders
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion")
+	FTerrainErosionSettings Erosion;
+
+	//Initial number of intervals the TerrainHeight curve is baked into
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Noise")
+	int TerrainHeightTableResolution;
+
+	//Maximum error of the baked TerrainHeight table against the curve, the resolution is raised until it fits
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Noise")
+	float TerrainHeightTableMaxError;
+
+	//Game thread time spent applying terrain uploads per frame, at least one upload is applied every frame. Zero is unlimited
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Performance")
+	float UploadBudgetMilliseconds;
+
+	//Bytes of mesh, collision and foliage data uploaded per frame. Zero is unlimited
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Performance")
+	int64 UploadBudgetBytes;
+
+	//Scale the job limit, upload budget, sections per pass and pass interval from measured frame time instead of using fixed values
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Performance")
+	bool bAdaptiveThrottling;
+
+	//Game thread time the throttling keeps below, generation backs off as frames approach it
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Performance")
+	float TargetFrameMilliseconds;
+
+	//Seconds between throttling decisions
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Performance")
+	float ThrottleInterval;
+
+	//Jobs still allowed when frames are over the target, MaxConcurrentJobs or the core count is the upper limit
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Performance")
+	int MinConcurrentJobs;
+
+	//Smallest fraction of the upload budgets kept when frames are over the target
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Performance", meta = (ClampMin = "0.0", ClampMax = "1.0"))
+	float MinUploadBudgetScale;
+
+	//Most sections spawned per pass while frames have headroom, without throttling one is spawned per pass
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Performance")
+	int MaxSectionsPerPass;
+
+	//Shortest interval between passes while frames have headroom, GenerationInterval is the longest
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Performance")
+	float MinGenerationInterval;
+
+	//CPU side terrain data kept before the least recently needed is evicted, in megabytes. Heightfields and erosion tiles count towards it. Zero keeps everything
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Memory")
+	int TerrainMemoryBudgetMB;
+
+	//Most recent section checksums the server keeps replicated for clients to compare against, one entry per section
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Network")
+	int MaxReplicatedChecksums;
+
+	UPROPERTY(ReplicatedUsing = OnRep_ReplicatedSettings)
+	FTerrainReplicatedSettings ReplicatedSettings;
+
+	UPROPERTY(ReplicatedUsing = OnRep_ServerChecksums)
+	TArray<FTerrainSectionChecksum> ServerChecksums;
+
+	//Broadcast on clients when a section generated differently from the server's
+	UPROPERTY(BlueprintAssignable, Category = "Landscape Network")
+	FTerrainDivergenceDelegate OnTerrainDivergence;
+
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Data")
 	TArray<ALandscapeSection*> SectionObjects;
 
 	UPROPERTY(BlueprintAssignable, Category = "Landscape Functions")
 	FGeneratedDelegate OnGenerated;
 
+	UPROPERTY(BlueprintAssignable, Category = "Landscape Functions")
+	FWarmupProgressDelegate OnWarmupProgress;
+
+	UFUNCTION(BlueprintPure, Category = "Landscape Functions")
+	bool IsWarmingUp() const { return bWarmingUp; }
+
+	UFUNCTION(BlueprintPure, Category = "Landscape Functions")
+	FTerrainMemoryStats GetMemoryStats() const { return MemoryStats; }
+
+	UFUNCTION(BlueprintPure, Category = "Landscape Functions")
+	FTerrainUploadStats GetUploadStats() const { return UploadStats; }
+
+	UFUNCTION(BlueprintPure, Category = "Landscape Functions")
+	FTerrainThrottleStats GetThrottleStats() const { return ThrottleStats; }
+
 	UFUNCTION(BlueprintCallable, Category = "Landscape Functions")
 	void StartGeneration();
+
+	//Stream terrain around an actor in addition to the player pawns, Radius is in sections
+	UFUNCTION(BlueprintCallable, Category = "Landscape Functions")
+	void RegisterStreamingAnchor(AActor* Anchor, int Radius);
+
+	UFUNCTION(BlueprintCallable, Category = "Landscape Functions")
+	void UnregisterStreamingAnchor(AActor* Anchor);
+
+	//Terrain height at a world location, read from resident sections or evaluated from the noise otherwise. Thread safe.
+	UFUNCTION(BlueprintCallable, Category = "Landscape Functions")
+	float GetHeightAt(FVector2D Location) const;
+
+	//Terrain normal at a world location. Thread safe.
+	UFUNCTION(BlueprintCallable, Category = "Landscape Functions")
+	FVector GetNormalAt(FVector2D Location) const;
+
+	UFUNCTION(BlueprintCallable, Category = "Landscape Functions")
+	void GetHeightsAt(const TArray<FVector2D>& Locations, TArray<float>& OutHeights) const;
+
+	UFUNCTION(BlueprintCallable, Category = "Landscape Functions")
+	void GetNormalsAt(const TArray<FVector2D>& Locations, TArray<FVector>& OutNormals) const;
+
+	//First hit of a segment against the resident sections' heightfields, without touching their collision. Thread safe.
+	//Sections whose height bounds the segment misses are skipped before any cell is tested
+	UFUNCTION(BlueprintCallable, Category = "Landscape Functions")
+	bool LineTraceTerrain(FVector Start, FVector End, FVector& OutLocation, FVector& OutNormal) const;
+
+	//Deforms the terrain within Radius of Center with a smooth falloff, only the touched vertices of resident sections are rebuilt
+	UFUNCTION(BlueprintCallable, Category = "Landscape Functions")
+	void DeformTerrain(FVector2D Center, float Radius, float Amount, ETerrainDeformationMode Mode);
 	
 protected:
 	// Called when the game starts or when spawned
@@ -105,4 +754,6 @@ public:
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
 
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
 };
@@ -5,17 +5,58 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Actor.h"
 #include "Providers/RuntimeMeshProviderCollision.h"
+#include "TerrainNoise.h"
+#include "TerrainHeightfield.h"
+#include "TerrainErosion.h"
+#include "TerrainDeformation.h"
 #include "LandscapeSection.generated.h"
 
 class ALandscapeGenerator;
 class UDiskSampler;
 class FGeneratorThread;
-class FRunnableThread;
 class URuntimeMeshComponent;
 class URuntimeMeshProviderStatic;
 class UHierarchicalInstancedStaticMeshComponent;
 class UStaticMesh;
 
+//Poisson disk spacing of foliage points and the height above which no foliage is placed
+#define FOLIAGE_POINT_RADIUS 1100
+#define FOLIAGE_POINT_ATTEMPTS 10
+#define FOLIAGE_MAX_HEIGHT 6000
+
+//Heights are checksummed on a fixed lattice of this many samples per axis, whatever LOD the section was generated at
+#define CHECKSUM_LATTICE_SIZE 17
+
+//Seed of the foliage points of a base section
+int64 CalcFoliageSeed(int32 Seed, const FIntPoint& TerrainCoords);
+
+//Number of vertices along one axis of a section grid sampled at the given LOD
+int CalcLODGridSize(int Components, int LOD);
+//Full resolution sample index of a LOD grid index, indices outside the grid map onto the neighbouring sections
+int CalcLODSampleIndex(int Components, int LOD, int GridIndex);
+//LOD grid index of a full resolution sample index
+int CalcLODGridIndexFromSample(int Components, int LOD, int SampleIndex);
+
+//CPU side section data tracked by the terrain memory budget
+UENUM(BlueprintType)
+enum class ETerrainMemoryCategory : uint8
+{
+	//Vertices, indices and normals at the generated resolution
+	MeshData,
+	//Subsampled copy uploaded for coarser LODs
+	LODData,
+	CollisionData,
+	FoliagePoints,
+	//Published copy of the heights with its height ranges, kept for queries and never evicted
+	Heightfield
+};
+
+enum THREAD_OPERATION {
+	GEN_LANDSCAPE,
+	GEN_LOD,
+	GEN_COLLISION
+};
+
 UCLASS()
 class PROCTERRAINGEN_API ALandscapeSection : public AActor
 {
@@ -25,7 +66,7 @@ public:
 	// Sets default values for this actor's properties
 	ALandscapeSection();
 
-	void InitialiseSection(ALandscapeGenerator* LandscapeGen, FIntPoint TerrainCoords, uint32 Seed, const FVector2D& SectionSize, const FIntPoint& ComponentsPerAxis, float fNoiseScale, float fHeightScale, float fLacunarity, float fPersistance, int Octaves);
+	void InitialiseSection(ALandscapeGenerator* LandscapeGen, FIntPoint TerrainCoords, uint32 Seed, const FVector2D& SectionSize, const FIntPoint& ComponentsPerAxis, const FTerrainNoiseParameters& NoiseParams, int InitialLOD, int NodeLevel);
 	
 	bool IsOriginCoord(const FVector& PlayerLocation);
 	bool GenerateLODData(int LOD);
@@ -38,9 +79,40 @@ public:
 	void RemoveFoliage();
 
 	void GenerateSectionMeshData();
+	void GenerateSectionNormals(const FIntPoint& OverallComponents);
+	//Recomputes the normals of an inclusive rect of grid vertices
+	void UpdateSectionNormals(const FIntPoint& OverallComponents, const FIntRect& VertexRect);
+	void BuildHeightfield(const FIntPoint& GridSize);
+	void AppendSectionSkirt(const FIntPoint& GridSize);
+	//Appends the triangles of a vertex grid sampled at LOD, adaptively when the generator asks for it and the grid allows it
+	void TriangulateGrid(const TArray<FVector3f>& GridVertices, const FIntPoint& GridSize, int LOD, TArray<int32>& OutIndices) const;
 	void UpdateTerrainSection(int LOD);
+	void UpdateCollisionOnlySection(int LOD);
+	void StartOperation(THREAD_OPERATION Operation);
+	bool StartPendingOperation();
+	void OnOperationFinished();
 	void RemoveSection();
 
+	//Patches the vertices, normals, LOD data, collision and foliage touched by deltas in an inclusive lattice rect.
+	//Deferred until the running operation completes if a worker owns the section data
+	void ApplyDeformation(const FIntRect& LatticeRect);
+	//Full resolution lattice rect covered by the section, grown by Margin lattice points on every side
+	FIntRect CalcSectionLatticeRect(int Margin) const;
+	//Queues the mesh for the current LOD with its foliage and material
+	void QueueDisplayUpload();
+
+	//Bounds of the generated surface without skirts, invalid until the mesh data is generated
+	FBox GetTerrainBounds() const;
+
+	//Bytes of CPU side data held in a category
+	int64 GetMemoryUsage(ETerrainMemoryCategory Category) const;
+	//Last time the data of a category was generated, uploaded or still needed by a grid pass, in platform seconds
+	double GetLastUsedTime(ETerrainMemoryCategory Category) const;
+	//Marks the data the section currently displays as used, called for every visible section on each grid pass
+	void TouchDisplayedData(double Now);
+	//Frees the data of a category if nothing is reading it, it is regenerated when needed again. Returns the bytes freed
+	int64 EvictData(ETerrainMemoryCategory Category);
+
 	bool FoliageGenerated;
 	bool PointsGenerated;
 	bool bMeshGenerated;
@@ -56,25 +128,63 @@ public:
 
 	//Multithreader
 	FGeneratorThread* Thread;
+	THREAD_OPERATION PendingOperation;
+	bool bOperationPending;
+	//Set from starting an operation until its completion has been handled on the game thread
+	bool bOperationRunning;
+	//Number of game thread uploads queued on the generator for this section
+	int PendingUploads;
 
 	//Section Info
 	FIntPoint mTerrainCoords;
+	//Quadtree level, sections at level N cover 2^N base sections along each axis
+	int mNodeLevel;
 	int LODLevel;
+	//Number of streaming sources that can currently see this section
+	int SourceRefCount;
+	//LOD the generator last asked for, the section keeps stepping towards it as operations finish
+	int TargetLOD;
 	int GenLOD;
+	int MeshDataLOD;
+	int SampledLOD;
+	int CollisionLOD;
 	bool GeneratingLOD;
 	bool GeneratingCollision;
 	bool CollisionGenerated;
+	//Headless server sections only build collision, no normals, LODs or render sections
+	bool mCollisionOnly;
+	//Mesh data was dropped by the memory budget, it is regenerated before the section changes again
+	bool bMeshDataEvicted;
+	double MeshDataLastUsed;
+	double LODDataLastUsed;
+	double CollisionLastUsed;
 
 	//Section Data
 	FVector mMeshOrigin;
 	FIntPoint mComponentsPerAxis;
-	float mNoiseScale;
-	float mHeightScale;
-	float mLacunarity;
-	float mPersistance;
-	int mOctaves;
+	float mSkirtDepth;
+	FTerrainNoiseParameters mNoiseParams;
+	//Erosion tiles covering the section, only grid sections and quadtree leaves are eroded
+	FTerrainErosionTileSet mErosionTiles;
 	int GlobalSeed;
 
+	//Deformation deltas the mesh data was generated with
+	TSharedPtr<FTerrainDeformation, ESPMode::ThreadSafe> mDeformation;
+	FTerrainDeltaTileSet mDeltaTiles;
+	bool bDeformationPending;
+	FIntRect PendingDeformationRect;
+	FBox2D PendingFoliageRect;
+
+	//Checksums of the last generated mesh data, handed to the generator once the operation finishes
+	uint32 mHeightChecksum;
+	uint32 mPointsChecksum;
+	bool bChecksumPending;
+	//Foliage points only depend on the seed, so their checksum is computed once per section
+	bool bPointsChecksumValid;
+
+	//Heights of the generated mesh data, shared with the generator for height queries
+	TSharedPtr<const FTerrainHeightfield, ESPMode::ThreadSafe> mHeightfield;
+
 	FRuntimeMeshCollisionData CollisionData;
 
 	TArray<FVector3f> mSectionVertices;
@@ -89,6 +199,13 @@ public:
 
 	TArray<FVector3f> mCollisionVertices;
 
+	//Mesh data vertex each skirt, LOD and collision vertex was copied from, so deformation can patch them in place
+	TArray<int32> mSkirtSourceIndices;
+	TArray<int32> mLODSourceIndices;
+	TArray<int32> mCollisionSourceIndices;
+	//Point each foliage instance was placed at
+	TArray<int32> mFoliagePointIndices;
+
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Points")
 	UDiskSampler* Points;
 protected:
@@ -99,28 +216,26 @@ public:
 
 };
 
-enum THREAD_OPERATION {
-	GEN_LANDSCAPE,
-	GEN_LOD,
-	GEN_COLLISION
-};
-
-class FGeneratorThread : public FRunnable
+//One section's operations, queued on the shared thread pool one at a time
+class FGeneratorThread : public IQueuedWork
 {
 public:
-	FGeneratorThread(ALandscapeSection* Section);
+	FGeneratorThread(ALandscapeSection* Section, FThreadSafeCounter* JobCounter);
+	//Game thread only, the section never starts an operation while one is running
 	bool StartOperation(THREAD_OPERATION operation);
 
-	virtual ~FGeneratorThread() override;
+	//Retracts queued work or waits for running work, the section may be destroyed right after
+	virtual ~FGeneratorThread();
 
-	bool Init() override;
-	uint32 Run() override;
-	void Stop() override;
+	virtual void DoThreadedWork() override;
+	virtual void Abandon() override;
 
 private:
-	FRunnableThread* Thread;
 	ALandscapeSection* mSection;
+	FThreadSafeCounter* mJobCounter;
 	THREAD_OPERATION mOperation;
 
-	bool bRunThread;
+	//Triggered once the queued work has run or been abandoned
+	FEvent* DoneEvent;
+	bool bQueued;
 };
\ No newline at end of file
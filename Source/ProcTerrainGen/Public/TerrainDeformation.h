@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+//Height offsets of the lattice points owned by one base section, immutable once published
+struct PROCTERRAINGEN_API FTerrainDeltaTile
+{
+	TMap<FIntPoint, float> Deltas;
+};
+
+typedef TSharedPtr<const FTerrainDeltaTile, ESPMode::ThreadSafe> FTerrainDeltaTilePtr;
+
+/**
+ * Delta tiles a section was generated with, so worker threads can read them without locking.
+ */
+struct PROCTERRAINGEN_API FTerrainDeltaTileSet
+{
+	FIntPoint TileSize = FIntPoint(1, 1);
+	TMap<FIntPoint, FTerrainDeltaTilePtr> Tiles;
+
+	float GetDelta(const FIntPoint& Lattice) const;
+};
+
+/**
+ * Sparse height deltas on top of the procedural terrain, keyed on the full resolution vertex lattice shared by every section.
+ * Deltas live here rather than in the sections so they survive sections being removed and generated again.
+ * Tiles are replaced as a whole when edited, readers on other threads keep whatever tile they already hold.
+ */
+class PROCTERRAINGEN_API FTerrainDeformation
+{
+public:
+	FTerrainDeformation(const FVector2D& InVertexSpacing, const FIntPoint& InTileSize);
+
+	//Closest lattice point to a world location
+	FIntPoint WorldToLattice(const FVector2D& Location) const;
+	FVector2D LatticeToWorld(const FIntPoint& Lattice) const;
+
+	//Tiles with deltas inside an inclusive lattice rect
+	FTerrainDeltaTileSet GatherTiles(const FIntRect& LatticeRect) const;
+
+	//Bilinear interpolation of the deltas around a world location. Thread safe.
+	float SampleDelta(const FVector2D& Location) const;
+
+	//Sets every lattice point in an inclusive rect to the delta Modify returns for its current delta. Game thread only
+	void ModifyDeltas(const FIntRect& LatticeRect, TFunctionRef<float(const FIntPoint& Lattice, float Delta)> Modify);
+
+private:
+	FIntPoint CalcTileCoord(const FIntPoint& Lattice) const;
+
+	FVector2D VertexSpacing;
+	FIntPoint TileSize;
+
+	mutable FRWLock TileLock;
+	TMap<FIntPoint, FTerrainDeltaTilePtr> Tiles;
+};
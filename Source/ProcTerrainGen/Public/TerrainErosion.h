@@ -0,0 +1,127 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TerrainErosion.generated.h"
+
+struct FTerrainNoiseParameters;
+
+USTRUCT(BlueprintType)
+struct PROCTERRAINGEN_API FTerrainErosionSettings
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion")
+	bool bEnabled = false;
+
+	//Samples per axis of an erosion tile, a tile spans two sections per axis
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion", meta = (ClampMin = "9", ClampMax = "257"))
+	int TileResolution = 65;
+
+	//Droplets and their lifetime cap the hydraulic work per tile, so every tile costs the same no matter which thread runs it
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion")
+	int DropletsPerTile = 2000;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion")
+	int MaxDropletLifetime = 30;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion")
+	float Inertia = 0.05f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion")
+	float SedimentCapacity = 4.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion")
+	float MinSedimentCapacity = 0.01f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion")
+	float ErodeSpeed = 0.3f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion")
+	float DepositSpeed = 0.3f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion")
+	float EvaporateSpeed = 0.01f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion")
+	float Gravity = 4.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion")
+	int ThermalIterations = 10;
+
+	//Steepest slope material rests at before thermal erosion moves it downhill
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion")
+	float TalusSlope = 0.6f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Landscape Erosion", meta = (ClampMin = "0", ClampMax = "1"))
+	float ThermalRate = 0.5f;
+};
+
+/**
+ * Height change from eroding one tile. Tiles are centred on section corners and span two sections per axis,
+ * so every point is covered by four tiles whose tent weights sum to one and section borders never see a tile edge.
+ */
+struct PROCTERRAINGEN_API FTerrainErosionTile
+{
+	FIntPoint TileCoord;
+	//World position of the first sample
+	FVector2D Origin;
+	FVector2D Spacing;
+	int Resolution;
+	TArray<float> Delta;
+
+	float SampleDelta(const FVector2D& Location) const;
+};
+
+typedef TSharedPtr<const FTerrainErosionTile, ESPMode::ThreadSafe> FTerrainErosionTilePtr;
+
+/**
+ * Erosion tiles of a section's footprint, gathered once before its vertices are generated.
+ */
+struct PROCTERRAINGEN_API FTerrainErosionTileSet
+{
+	FIntPoint MinTile;
+	FIntPoint NumTiles;
+	TArray<FTerrainErosionTilePtr> Tiles;
+
+	const FTerrainErosionTile* FindTile(const FIntPoint& TileCoord) const;
+};
+
+/**
+ * Thread-safe cache of eroded tiles. Tiles depend only on their coord, the seed and the settings,
+ * so threads racing on the same tile produce identical results and a revisited coord is never eroded again.
+ */
+class PROCTERRAINGEN_API FTerrainErosionCache
+{
+public:
+	FTerrainErosionCache(const FTerrainErosionSettings& InSettings, const FVector2D& InSectionSize, uint32 InSeed);
+
+	//Builds any missing tiles covering the area in parallel
+	FTerrainErosionTileSet GatherTiles(const FVector2D& Min, const FVector2D& Max, const FTerrainNoiseParameters& NoiseParams);
+
+	//Blended height change at a location, TileSet is checked before the cache
+	float SampleDelta(const FVector2D& Location, const FTerrainNoiseParameters& NoiseParams, const FTerrainErosionTileSet* TileSet = nullptr);
+
+	//Same as SampleDelta but never builds a tile, false if any covering tile isn't cached
+	bool SampleCachedDelta(const FVector2D& Location, float& OutDelta) const;
+
+	//Drops tiles no section's tile set holds anymore, returns the number dropped
+	int32 EvictUnreferencedTiles();
+
+	int64 GetMemoryUsage() const;
+
+private:
+	FTerrainErosionTilePtr FindOrBuildTile(const FIntPoint& TileCoord, const FTerrainNoiseParameters& NoiseParams);
+	FTerrainErosionTilePtr BuildTile(const FIntPoint& TileCoord, const FTerrainNoiseParameters& NoiseParams) const;
+
+	void ErodeHydraulic(TArray<float>& Heights, int Resolution, FRandomStream& Random) const;
+	void ErodeThermal(TArray<float>& Heights, int Resolution) const;
+
+	FTerrainErosionSettings Settings;
+	FVector2D SectionSize;
+	uint32 Seed;
+
+	mutable FRWLock TileLock;
+	TMap<FIntPoint, FTerrainErosionTilePtr> Tiles;
+};
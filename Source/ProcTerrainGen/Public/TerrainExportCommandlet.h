@@ -0,0 +1,26 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "TerrainExportCommandlet.generated.h"
+
+/**
+ * Exports heightmaps and foliage points of a region of base sections straight from the terrain function, no world or actors involved.
+ * The region is split into tiles of TileSections sections that are evaluated in parallel and written one at a time,
+ * so memory is bounded by the tile size rather than the region size.
+ *
+ * -run=TerrainExport -Generator=/Game/Path/BP_Generator.BP_Generator_C -MinX=0 -MinY=0 -MaxX=49 -MaxY=49
+ *     [-Seed=0] [-Format=RAW|EXR] [-TileSections=8] [-HeightMin=-10000 -HeightMax=10000] [-Out=Dir] [-NoPoints]
+ */
+UCLASS()
+class PROCTERRAINGEN_API UTerrainExportCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	UTerrainExportCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+};
@@ -0,0 +1,45 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TerrainNoise.h"
+#include "TerrainDeformation.h"
+
+//Base section merged into a far field chunk
+struct PROCTERRAINGEN_API FTerrainFarFieldCell
+{
+	FIntPoint Coord;
+	//Sides whose neighbour is in the far field as well, -X, +X, -Y, +Y from the lowest bit. Other sides get a skirt
+	uint8 ProxyNeighbours;
+};
+
+struct PROCTERRAINGEN_API FTerrainFarFieldMesh
+{
+	TArray<FVector3f> Vertices;
+	TArray<FVector3f> Normals;
+	TArray<int32> Indices;
+};
+
+/**
+ * Builds the merged low resolution mesh of one far field chunk. Only reads its own members, so it can run on any thread.
+ * Erosion is left out like on coarse quadtree nodes, its detail is finer than the far field spacing.
+ */
+struct PROCTERRAINGEN_API FTerrainFarFieldBuilder
+{
+	FTerrainNoiseParameters NoiseParams;
+	TSharedPtr<FTerrainDeformation, ESPMode::ThreadSafe> Deformation;
+	FVector2D SectionSize;
+	//Quads per section along each axis
+	int Resolution;
+	float SkirtDepth;
+	TArray<FTerrainFarFieldCell> Cells;
+
+	void Build(FTerrainFarFieldMesh& OutMesh) const;
+
+	//Changes whenever the cells or their neighbours change, used to skip rebuilding unchanged chunks
+	static uint32 CalcCellsHash(const TArray<FTerrainFarFieldCell>& Cells);
+
+private:
+	float CalculateHeight(const FVector2D& Location) const;
+};
@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Curves/RichCurve.h"
+
+/**
+ * Immutable lookup table baked from the TerrainHeight curve so worker threads never touch the curve UObject.
+ * Values outside the curve's key range follow the curve's pre and post infinity extrapolation.
+ */
+class PROCTERRAINGEN_API FTerrainHeightTable
+{
+public:
+	//Resolution is doubled until the error against the curve is within MaxError or MaxResolution is reached
+	FTerrainHeightTable(const FRichCurve& Curve, int Resolution, float MaxError, int MaxResolution = 65536);
+
+	float Evaluate(float Value) const
+	{
+		if (Value < MinTime || Value > MaxTime)
+			return EvaluateExtrapolated(Value);
+
+		float Position = FMath::Clamp((Value - MinTime) * InvStep, 0.0f, float(Samples.Num() - 1));
+		int Index = FMath::Min(FMath::FloorToInt(Position), Samples.Num() - 2);
+		return FMath::Lerp(Samples[Index], Samples[Index + 1], Position - Index);
+	}
+
+	int GetResolution() const { return Samples.Num() - 1; }
+	float GetMeasuredError() const { return MeasuredError; }
+
+	//Hash of everything that affects the curve's shape, used to detect when the table has to be rebaked
+	static uint32 CalcCurveHash(const FRichCurve& Curve);
+
+private:
+	float Bake(const FRichCurve& Curve, int Resolution);
+	float EvaluateExtrapolated(float Value) const;
+
+	TArray<float> Samples;
+	float MinTime;
+	float MaxTime;
+	float InvStep;
+	float MeasuredError;
+	ERichCurveExtrapolation PreExtrap;
+	ERichCurveExtrapolation PostExtrap;
+	//Slope per unit of time beyond either end, only used for linear extrapolation
+	float PreSlope;
+	float PostSlope;
+};
@@ -0,0 +1,48 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Immutable copy of a section's height samples, published to the generator for height queries.
+ * The grid follows the section's LOD layout, so the last cell along an axis may be narrower.
+ */
+struct PROCTERRAINGEN_API FTerrainHeightfield
+{
+	//World position of the first sample
+	FVector2D Origin;
+	//World distance between full resolution samples
+	FVector2D VertexSpacing;
+	FIntPoint Components;
+	int LOD;
+	FIntPoint GridSize;
+	TArray<float> Heights;
+
+	bool Contains(const FVector2D& Location) const;
+
+	//Bilinear interpolation of the height samples, locations outside the grid are clamped to its border
+	float SampleHeight(const FVector2D& Location) const;
+
+	//Min and max height of every grid cell at level 0, and of every 2x2 block of the level below above that, up to a single root
+	TArray<TArray<FVector2f>> HeightRanges;
+	TArray<FIntPoint> HeightRangeSizes;
+
+	//Builds HeightRanges from Heights, called once before the heightfield is published
+	void BuildHeightRanges();
+
+	int64 GetAllocatedSize() const;
+
+	//Bounds of the bilinear surface
+	FBox GetBounds() const;
+
+	//First point where the segment meets the bilinear surface, as a fraction of the way from Start to End.
+	//Walks the height ranges front to back so only the cells the segment could touch are solved
+	bool IntersectSegment(const FVector& Start, const FVector& End, double& OutT) const;
+
+private:
+	double CalcCellWorldX(int Cell) const;
+	double CalcCellWorldY(int Cell) const;
+	bool IntersectNode(const FVector& Start, const FVector& Delta, int Level, int X, int Y, double& OutT) const;
+	bool IntersectCell(const FVector& Start, const FVector& Delta, int X, int Y, double Enter, double Exit, double& OutT) const;
+};
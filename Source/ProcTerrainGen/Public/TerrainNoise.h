@@ -0,0 +1,37 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TerrainHeightTable.h"
+#include "TerrainNoiseGraph.h"
+
+class FTerrainErosionCache;
+
+/**
+ * Everything needed to evaluate the terrain height function without touching any UObject.
+ * Copies are handed to sections and queries so the function can be evaluated from any thread.
+ */
+struct PROCTERRAINGEN_API FTerrainNoiseParameters
+{
+	float NoiseScale = 0.1f;
+	float HeightScale = 1.0f;
+	float Lacunarity = 2.3f;
+	float Persistance = 0.6f;
+	int Octaves = 4;
+
+	TSharedPtr<const FTerrainHeightTable, ESPMode::ThreadSafe> HeightTable;
+	//Replaces the single fBm call above when set
+	TSharedPtr<const FCompiledNoiseGraph, ESPMode::ThreadSafe> NoiseGraph;
+	//Set when erosion is enabled, eroded tiles are shared by every copy of the parameters
+	TSharedPtr<FTerrainErosionCache, ESPMode::ThreadSafe> Erosion;
+
+	//Terrain height at a world position
+	float CalculateHeight(float WorldX, float WorldY) const;
+
+	//Terrain height for queries that must stay fast, never erodes a tile and leaves out erosion where it isn't cached
+	float CalculateQueryHeight(float WorldX, float WorldY) const;
+
+	//Terrain height before erosion
+	float CalculateBaseHeight(float WorldX, float WorldY) const;
+};
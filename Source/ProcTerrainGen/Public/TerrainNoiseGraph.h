@@ -0,0 +1,101 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "TerrainNoiseGraph.generated.h"
+
+//Highest octave count the noise kernels are specialized for
+#define MAX_NOISE_GRAPH_OCTAVES 8
+
+UENUM(BlueprintType)
+enum class ETerrainNoiseNodeType : uint8
+{
+	//Adds fractal simplex noise in the 0..1 range
+	Fbm,
+	//Adds ridged fractal noise, sharp crests where the noise crosses zero
+	Ridged,
+	//Offsets the sample position of every following node
+	DomainWarp,
+	//Scales the height built so far between 1 and Amplitude using a low frequency mask
+	BiomeBlend
+};
+
+/**
+ * One step of the terrain noise graph. Nodes are evaluated in order, each reading and updating the sample position and height.
+ */
+USTRUCT(BlueprintType)
+struct PROCTERRAINGEN_API FTerrainNoiseNode
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise Node")
+	ETerrainNoiseNodeType Type = ETerrainNoiseNodeType::Fbm;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise Node", meta = (ClampMin = "1", ClampMax = "8"))
+	int Octaves = 4;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise Node")
+	float Frequency = 1.0f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise Node")
+	float Lacunarity = 2.3f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise Node")
+	float Persistance = 0.6f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise Node")
+	float Amplitude = 1.0f;
+
+	//Offset in noise space so nodes sharing a frequency don't produce the same pattern
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Noise Node")
+	FVector2D Offset = FVector2D::ZeroVector;
+};
+
+struct FNoiseGraphState
+{
+	float X;
+	float Y;
+	float Height;
+};
+
+struct FCompiledNoiseNode;
+typedef void (*FNoiseNodeKernel)(const FCompiledNoiseNode& Node, FNoiseGraphState& State);
+
+struct FCompiledNoiseNode
+{
+	//Kernel specialized for the node type and octave count
+	FNoiseNodeKernel Kernel;
+	float Frequency;
+	float Lacunarity;
+	float Persistance;
+	float Amplitude;
+	float OffsetX;
+	float OffsetY;
+};
+
+/**
+ * Noise graph compiled into kernels specialized at compile time for each node type and octave count, so octave loops are unrolled
+ * and a whole graph is evaluated in a single pass per sample. Immutable once compiled and safe to share between threads.
+ */
+class PROCTERRAINGEN_API FCompiledNoiseGraph
+{
+public:
+	FCompiledNoiseGraph(const TArray<FTerrainNoiseNode>& Nodes);
+
+	//Raw terrain value at a position already scaled into noise space
+	float Evaluate(float X, float Y) const
+	{
+		FNoiseGraphState State = { X, Y, 0.0f };
+		for (const FCompiledNoiseNode& Node : CompiledNodes)
+			Node.Kernel(Node, State);
+
+		return State.Height;
+	}
+
+	//Hash of every node setting, used to detect when the graph has to be recompiled
+	static uint32 CalcGraphHash(const TArray<FTerrainNoiseNode>& Nodes);
+
+private:
+	TArray<FCompiledNoiseNode> CompiledNodes;
+};
@@ -0,0 +1,30 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Right-triangle irregular network over a square grid of 2^k + 1 vertices per axis.
+ * Triangles are split along their hypotenuse until the height error at the split point is within the threshold.
+ * Border vertices are always kept so the edges of neighbouring sections match without cracks.
+ */
+class PROCTERRAINGEN_API FTerrainRTIN
+{
+public:
+	//True when the grid can be triangulated adaptively
+	static bool SupportsGridSize(const FIntPoint& GridSize);
+
+	//Vertices is the row major vertex grid, only the heights are read
+	FTerrainRTIN(const TArray<FVector3f>& Vertices, int InGridSize);
+
+	//Appends grid vertex indices of a mesh within MaxError of the full grid, wound like the uniform grid
+	void Triangulate(float MaxError, TArray<int32>& OutIndices) const;
+
+private:
+	void ProcessTriangle(int AX, int AY, int BX, int BY, int CX, int CY, float MaxError, TArray<int32>& OutIndices) const;
+
+	int GridSize;
+	//Largest error of the split points below each vertex, the error that splitting at it removes
+	TArray<float> Errors;
+};